@@ -78,6 +78,35 @@ typedef struct Position {
 
 int nnue_evaluate_pos(Position* pos);
 
+/**
+* Brings pos->nnue[0] up to date from pos->nnue[1] (or nnue[2]) using the
+* dirty pieces. Returns false if neither previous accumulator is computed.
+*/
+bool nnue_update_accumulator(Position* pos);
+
+/**
+* Name of the SIMD kernel variant selected by nnue_init for this CPU
+*/
+const char* nnue_kernel_name(void);
+
+/**
+* Enumerates the compiled kernel variants (slowest first), for testing and
+* benchmarking. Returns NULL past the last one.
+*/
+int nnue_kernel_count(void);
+const char* nnue_kernel_info(int index, bool* supported);
+
+/**
+* Switches to the named kernel variant if this CPU supports it
+*/
+bool nnue_use_kernel(const char* name);
+
+/**
+* True once nnue_init has loaded a valid network. Engines fall back to
+* their own evaluation while this is false.
+*/
+bool nnue_loaded(void);
+
 /************************************************************************
 *         EXTERNAL INTERFACES
 *
@@ -0,0 +1,207 @@
+/**
+ *  @file book.cpp
+ *  @brief Implements the binary, memory-mapped opening book.
+ *
+ ** The book is a flat file of fixed-size entries sorted by the Zobrist key of the position
+ ** (Board::hash()), so a probe is a binary search over the mapped file: there is nothing to
+ ** parse when the engine starts, and the operating system shares the mapped pages between
+ ** every engine process that opens the same book.
+ *
+ *? File layout (little endian):
+ *? - BookHeader: magic "FURYBOOK", format version and number of entries.
+ *? - BookEntry[entries]: 64-bit key, 16-bit chess::Move, 16-bit weight and 32 unused bits,
+ *?   sorted by key (entries of the same position are contiguous).
+ *
+ *? Books are built from the JSON book ("fen": ["uci move", ...]) with OpeningBook::convert()
+ *? (the "makebook" command). A move's weight is the number of times it is listed for the position.
+ *
+ *! @warning The keys come from chess.hpp's Zobrist hashing; rebuild the book when updating that
+ *!          library, otherwise positions will simply not be found.
+*/
+
+constexpr char BOOK_MAGIC[8] = {'F', 'U', 'R', 'Y', 'B', 'O', 'O', 'K'};
+constexpr uint32_t BOOK_VERSION = 1;
+
+struct BookHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entries;
+};
+
+struct BookEntry {
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t unused;
+};
+
+static_assert(sizeof(BookHeader) == 16 && sizeof(BookEntry) == 16, "Book records must match the file layout");
+
+OpeningBook::~OpeningBook() {
+    /**
+     *  @brief Unmaps the book file, if one is open.
+    */
+    this->close();
+}
+
+OpeningBook::OpeningBook(OpeningBook&& other) noexcept {
+    /**
+     *  @brief Takes over the other book's mapping, leaving it closed.
+    */
+    *this = std::move(other);
+}
+
+OpeningBook& OpeningBook::operator=(OpeningBook&& other) noexcept {
+    /**
+     *  @brief Takes over the other book's mapping, leaving it closed.
+    */
+    if (this != &other) {
+        this->close();
+        std::swap(this->data, other.data);
+        std::swap(this->mapping, other.mapping);
+        std::swap(this->entries, other.entries);
+        std::swap(this->count, other.count);
+    }
+    return *this;
+}
+
+bool OpeningBook::open(const std::string& path) {
+    /**
+     *  @brief Maps a binary book file into memory.
+     *
+     ** The file is only validated (magic, version and size), never read in full: pages are
+     ** loaded lazily by the operating system when a probe touches them.
+     *
+     *  @param path Path of the binary book.
+     *  @return True if the book was mapped and is valid; otherwise false and the book is empty.
+    */
+    this->close();
+
+    FD fd = open_file(path.c_str());
+    if (fd == FD_ERR) return false;
+    const size_t size = file_size(fd);
+    if (size < sizeof(BookHeader)) {
+        close_file(fd);
+        return false;
+    }
+    map_t mapping;
+    const void* data = map_file(fd, &mapping);
+    close_file(fd);
+    if (!data) return false;
+
+    const BookHeader* header = static_cast<const BookHeader*>(data);
+    const bool valid = std::memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) == 0
+                    && header->version == BOOK_VERSION
+                    && size >= sizeof(BookHeader) + size_t(header->entries) * sizeof(BookEntry);
+    if (!valid) {
+        unmap_file(data, mapping);
+        return false;
+    }
+
+    this->data = data;
+    this->mapping = mapping;
+    this->entries = reinterpret_cast<const BookEntry*>(header + 1);
+    this->count = header->entries;
+    return true;
+}
+
+void OpeningBook::close() {
+    /**
+     *  @brief Unmaps the book. Probing a closed book never finds a move.
+    */
+    if (this->data) unmap_file(this->data, this->mapping);
+    this->data = nullptr;
+    this->entries = nullptr;
+    this->count = 0;
+}
+
+Move OpeningBook::probe(const Board& board) const {
+    /**
+     *  @brief Picks a book move for the position, at random in proportion to the move weights.
+     *
+     *  @param board The current position.
+     *  @return A legal book move, or Move::NO_MOVE if the position is not in the book.
+    */
+    const uint64_t key = board.hash();
+    const BookEntry* end = this->entries + this->count;
+    const BookEntry* first = std::lower_bound(this->entries, end, key,
+                                              [](const BookEntry& entry, uint64_t k) { return entry.key < k; });
+
+    uint32_t total = 0;
+    const BookEntry* last = first;
+    for (; last != end && last->key == key; last++) total += last->weight;
+    if (total == 0) return Move::NO_MOVE;
+
+    static std::mt19937 gen(std::random_device{}()); // Static for persistent engine
+    uint32_t pick = std::uniform_int_distribution<uint32_t>(0, total - 1)(gen);
+
+    const BookEntry* chosen = first;
+    while (pick >= chosen->weight) pick -= (chosen++)->weight;
+
+    //! Guards against hash collisions and books built for a different move encoding.
+    Movelist legal;
+    movegen::legalmoves(legal, board);
+    const Move move(chosen->move);
+    return std::find(legal.begin(), legal.end(), move) != legal.end() ? move : Move(Move::NO_MOVE);
+}
+
+int OpeningBook::convert(const std::string& json_path, const std::string& book_path) {
+    /**
+     *  @brief Builds a binary book from a JSON book.
+     *
+     ** Every FEN key (without the move counters) is hashed with chess.hpp, every listed move is
+     ** checked for legality, and duplicate moves of a position are merged by adding up their weights.
+     *
+     *  @param json_path  The JSON book ({"fen": ["uci move", ...]}).
+     *  @param book_path  Where to write the binary book.
+     *  @return The number of entries written, or -1 if a file could not be read or written.
+    */
+    std::ifstream input(json_path);
+    if (!input.is_open()) return -1;
+
+    json book;
+    try {
+        book = json::parse(input);
+    } catch (json::parse_error& e) {
+        Bot::LogToFile("JSON parse error: "); Bot::LogToFile(e.what());
+        return -1;
+    }
+
+    std::vector<BookEntry> entries;
+    Board board;
+    for (auto& [fen, moves] : book.items()) {
+        board.setFen(fen + " 0 1");
+        Movelist legal;
+        movegen::legalmoves(legal, board);
+
+        for (const auto& uci_move : moves) {
+            const Move move = uci::uciToMove(board, uci_move.get<std::string>());
+            if (std::find(legal.begin(), legal.end(), move) == legal.end()) continue; //* Skip illegal moves.
+            entries.push_back(BookEntry{board.hash(), move.move(), 1, 0});
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    std::vector<BookEntry> merged;
+    for (const BookEntry& entry : entries) {
+        if (!merged.empty() && merged.back().key == entry.key && merged.back().move == entry.move) {
+            merged.back().weight = uint16_t(std::min<int>(merged.back().weight + entry.weight, UINT16_MAX));
+        } else {
+            merged.push_back(entry);
+        }
+    }
+
+    BookHeader header{};
+    std::memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.version = BOOK_VERSION;
+    header.entries = static_cast<uint32_t>(merged.size());
+
+    std::ofstream output(book_path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) return -1;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(merged.data()), std::streamsize(merged.size() * sizeof(BookEntry)));
+    return output ? static_cast<int>(merged.size()) : -1;
+}
@@ -6,10 +6,15 @@
  *? across several modular components, including:
  *?  - constructors.cpp: Bot class constructors and FEN initialisation.
  *?  - evaluate.cpp: Positional and material evaluation routines.
- *?  - openings.cpp: Opening book parsing and selection.
+ *?  - book.cpp: Memory-mapped binary opening book and its JSON converter.
+ *?  - resources.cpp: Book and evaluation tables loaded once per process and shared by every Bot.
+ *?  - openings.cpp: Opening book move selection.
+ *?  - checks.cpp: Gives-check detection from precomputed check squares, without playing the move.
  *?  - search.cpp: Search algorithms (e.g., negamax and minimax) with pruning techniques.
+ *?  - threadpool.cpp: Process-wide worker pool shared by search, perft and batch work.
  *?  - bothelpers.cpp: Utility functions for move ordering, checks, and evaluations.
  *?  - findmove.cpp: Interfaces to determine and return the best move from the current position.
+ *?  - timeman.cpp: Clock-based time allocation for the iterative deepening search.
  *
  ** Also includes the definition for Bot::get_best_move, a high-level dispatcher that selects 
  ** the appropriate strategy (opening, middlegame, or endgame) based on game phase and board state.
@@ -17,12 +22,17 @@
 
 #include "constructors.cpp"
 #include "evaluate.cpp"
+#include "book.cpp"
+#include "resources.cpp"
 #include "openings.cpp"
+#include "checks.cpp"
 #include "search.cpp"
+#include "threadpool.cpp"
 #include "bothelpers.cpp"
 #include "findmove.cpp"
+#include "timeman.cpp"
 
-std::string Bot::get_best_move(Board& board, char colour, int depth=-1) {
+std::string Bot::get_best_move(Board& board, char colour, const SearchLimits& limits = SearchLimits()) {
     /**
      *  @brief Selects and returns the best move for the given board and player.
      *
@@ -32,20 +42,38 @@ std::string Bot::get_best_move(Board& board, char colour, int depth=-1) {
      *? - 'm' (middlegame): Applies multi-threaded search using evaluation heuristics.
      *? - otherwise (endgame): Falls back to deeper middlegame logic.
      *
-     ** If a custom depth is not specified (depth = -1), the engine determines an appropriate
-     ** search depth dynamically based on the board state.
+     ** The search deepens iteratively until the time budget computed from the limits runs out.
+     ** If the limits contain no clock information, the engine instead searches to the requested
+     ** depth, or determines an appropriate depth dynamically based on the board state. Infinite
+     ** searches deepen until Bot::stop_search is raised.
+     *
+     *! @warning The caller must lower Bot::stop_search before the search starts; it is not reset
+     *!          here so that a "stop" arriving before the search begins is not lost.
      *
      *  @param board  Reference to the current board state.
      *  @param colour The player to move ('w' for white, 'b' for black).
-     *  @param depth  Optional search depth override. Defaults to -1 (auto-determined).
+     *  @param limits Clock, movetime and depth constraints from the "go" command.
      *  @return A string representing the best move in UCI format.
     */
 
-    if (this->game_stage == 'o') return Bot::opening_move(board.getFen(), colour);
-    else if (this->game_stage == 'm'){
-        int d = depth == -1 ? Bot::determineDepth(board) : depth;
-        return this->middle_game_x_thread(d, board, colour);
-    }else {
-        return this->middle_game_x_thread(11, board, colour);
-    }
+    TT.new_search();
+    this->limits = limits;
+    this->ponder_move = Move::NO_MOVE;
+    if (this->game_stage == 'o') return Bot::opening_move(board, colour);
+
+    int max_depth = Bot::determineDepth(board);
+    if (limits.depth > 0) max_depth = limits.depth;
+    else if (limits.is_timed() || limits.infinite) max_depth = MAX_DEPTH;
+
+    this->time_manager.init(limits, board.sideToMove());
+    return this->middle_game_x_thread(max_depth, board, colour);
+}
+
+std::string Bot::get_ponder_move() const {
+    /**
+     *  @brief The reply expected after the last best move, for "bestmove ... ponder".
+     *
+     *  @return The move in UCI format, or an empty string if the last search found none.
+    */
+    return this->ponder_move == Move::NO_MOVE ? "" : uci::moveToUci(this->ponder_move);
 }
@@ -12,14 +12,16 @@
  *! Features:
  *! - Multiple constructors for FEN initialisation and game stage control.
  *! - Heuristics for evaluation using handcrafted piece-square tables and material values.
- *! - Opening book integration using JSON-based storage.
+ *! - Opening book integration using a memory-mapped binary book (see book.cpp).
  *! - Static utilities for logging and board visualisation.
  *! - Search algorithms including minimax and negamax with alpha-beta pruning.
  *! - Move ordering and utility functions to assist in efficient decision-making.
  *
  *? Dependencies:
  *? - chess.hpp: Board representation and move generation.
- *? - json.hpp: Parsing of opening book data.
+ *? - json.hpp: Parsing of the JSON opening book when converting it.
+ *? - nnue.h: NNUE accumulator types kept on every search thread's stack.
+ *? - misc.h: File mapping helpers shared with the NNUE loader.
  *
  ** This class forms the core decision-making module of the UCI engine backend.
  */
@@ -33,8 +35,15 @@
 #include <future>
 #include <functional>
 #include <chrono>
+#include <cmath>
+#include <atomic>
+#include <memory>
 #include "3rdparty/json.hpp"
 #include "3rdparty/chess.hpp"
+#define DLL_EXPORT
+#include "NNUE/nnue.h"
+#undef DLL_EXPORT
+#include "NNUE/misc.h"
 
 using json = nlohmann::json;
 using namespace chess;
@@ -246,6 +255,233 @@ struct PieceTables {
     };
 };
 
+//* A midgame and an endgame score packed into one integer (endgame in the upper 16 bits), so both
+//* phases are accumulated with a single addition per piece (see evaluate.cpp).
+using PackedScore = int32_t;
+
+struct PackedPieceTables {
+    /**
+     *  @struct PackedPieceTables
+     *  @brief The PieceTables merged into one signed midgame/endgame score per piece and square.
+     *
+     ** Indexed by chess::Piece (WHITEPAWN = 0 ... BLACKKING = 11) and square (a1 = 0). Black
+     ** entries are already negated, so the evaluation only ever adds.
+    */
+    PackedScore psqt[12][64];
+
+    explicit PackedPieceTables(const PieceTables& tables);
+};
+
+constexpr int MAX_DEPTH = 64; //* Deepest iteration the iterative deepening loop will start.
+constexpr int MAX_PLY = 128;  //* Deepest reachable ply: MAX_DEPTH plus the root move and the quiescence search.
+
+//* Search and evaluation score in centipawns from the side to move's perspective. Mate scores
+//* count down from VALUE_MATE by the distance in plies from the root (see mate_in()), so a
+//* faster mate always scores higher. Converted to the UCI "cp"/"mate" field by score_to_uci().
+using Value = int16_t;
+
+constexpr int VALUE_DRAW = 0;
+constexpr int VALUE_MATE = 32000;
+constexpr int VALUE_INFINITE = 32001;                           //* Outside every real score, for the initial window.
+constexpr int VALUE_NONE = 32002;                               //* No score, e.g. no static evaluation while in check.
+constexpr int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;     //* Scores at least this large are mates.
+constexpr int VALUE_MATED_IN_MAX_PLY = -VALUE_MATE_IN_MAX_PLY;
+
+constexpr Value mate_in(int ply) { return static_cast<Value>(VALUE_MATE - ply); }
+constexpr Value mated_in(int ply) { return static_cast<Value>(-VALUE_MATE + ply); }
+constexpr bool is_mate_score(int value) { return value >= VALUE_MATE_IN_MAX_PLY || value <= VALUE_MATED_IN_MAX_PLY; }
+
+struct SearchLimits {
+    /**
+     *  @struct SearchLimits
+     *  @brief Search constraints parsed from a UCI "go" command.
+     *
+     ** A value of -1 means the parameter was not supplied. When neither a clock nor a
+     ** movetime is given, the search runs to a fixed depth instead of a time budget, unless
+     ** it is infinite ("go infinite"), in which case it only ends on "stop". A ponder search
+     ** ("go ponder") ignores its clock until "ponderhit" (see Bot::pondering).
+    */
+    int wtime = -1;
+    int btime = -1;
+    int winc = 0;
+    int binc = 0;
+    int movestogo = 0;
+    int movetime = -1;
+    int depth = -1;
+    int move_overhead = 10; //* Milliseconds reserved for GUI/network lag (UCI "Move Overhead").
+    bool infinite = false;
+    bool ponder = false;
+    int multi_pv = 1;       //* Number of best root moves to rank and report (UCI "MultiPV").
+
+    bool is_timed() const { return this->movetime >= 0 || this->wtime >= 0 || this->btime >= 0; }
+};
+
+class TimeManager {
+    /**
+     *  @class TimeManager
+     *  @brief Allocates and tracks the thinking time for a single move.
+     *
+     ** Converts the clock parameters of a "go" command into two budgets:
+     *? - soft limit: no new iterative deepening iteration is started once it has passed.
+     *? - hard limit: the running search is aborted as soon as it is exceeded.
+     *
+     ** A default constructed TimeManager never runs out of time.
+    */
+    public:
+        void init(const SearchLimits& limits, Color side_to_move);
+
+        int64_t elapsed() const;
+        bool soft_limit_reached() const;
+        bool hard_limit_reached() const;
+
+    private:
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int64_t soft_limit = -1;
+        int64_t hard_limit = -1;
+};
+
+struct BookEntry;
+
+class OpeningBook {
+    /**
+     *  @class OpeningBook
+     *  @brief Read-only view of a memory-mapped binary opening book (see book.cpp).
+     *
+     ** Movable but not copyable, since it owns the file mapping.
+    */
+    public:
+        OpeningBook() = default;
+        ~OpeningBook();
+        OpeningBook(const OpeningBook&) = delete;
+        OpeningBook& operator=(const OpeningBook&) = delete;
+        OpeningBook(OpeningBook&& other) noexcept;
+        OpeningBook& operator=(OpeningBook&& other) noexcept;
+
+        bool open(const std::string& path);
+        void close();
+        bool empty() const { return this->count == 0; }
+        uint32_t size() const { return this->count; }
+
+        Move probe(const Board& board) const;
+
+        static int convert(const std::string& json_path, const std::string& book_path);
+
+    private:
+        const void* data = nullptr;
+        map_t mapping{};
+        const BookEntry* entries = nullptr;
+        uint32_t count = 0;
+};
+
+struct EngineResources {
+    /**
+     *  @struct EngineResources
+     *  @brief Immutable data loaded once per process and borrowed by every Bot (see resources.cpp).
+     *
+     ** Bots are recreated for every game and position, so anything expensive to build or load
+     ** lives here instead: the opening book mapping and the evaluation tables. The NNUE weights
+     ** are process-wide inside the NNUE library and are loaded by EngineResources::load() too.
+    */
+    PieceTables piece_tables;
+    PackedPieceTables packed_tables{piece_tables};
+    OpeningBook opening_book;
+    std::string book_path;
+
+    void load(const std::string& nnue_path, const std::string& book_path);
+    bool reload_book();
+};
+
+extern EngineResources Resources;
+
+struct PvLine {
+    /**
+     *  @struct PvLine
+     *  @brief One ranked root move of a completed iteration: its score and principal variation.
+    */
+    Value score = VALUE_DRAW;
+    std::vector<Move> pv;   //* Starts with the root move itself.
+};
+
+struct SearchHistory {
+    /**
+     *  @struct SearchHistory
+     *  @brief Quiet move statistics of one search thread, used to order the moves of Bot::negamax().
+     *
+     ** A quiet move that caused a beta cutoff is likely to cut off again in similar positions,
+     ** so every quiet cutoff is recorded in several tables (see Bot::update_quiet_stats()):
+     *? - killers: the last two quiet cutoff moves of every ply.
+     *? - butterfly: indexed by the side to move and the move's from and to squares.
+     *? - countermoves: the quiet cutoff reply to the previous move, by its piece and destination.
+     *? - continuation: indexed by the piece and destination of an earlier move (the opponent's last
+     *?   move or the side's own previous one) and of the current move.
+     *
+     ** The MovePicker of every negamax node reads them back: the killers and the countermove get
+     ** their own stages, and the remaining quiet moves are ordered by SearchThread::quiet_history().
+     *
+     ** History scores use "gravity": a bonus shrinks as the entry approaches MAX_HISTORY, so the
+     ** entries stay bounded and old statistics fade as new ones arrive, even across searches.
+    */
+    static constexpr int MAX_HISTORY = 16384;
+
+    Move killers[MAX_PLY + 1][2];
+    int16_t butterfly[2][64][64];
+    Move countermoves[12][64];
+    int16_t continuation[12][64][12][64];
+
+    static void update(int16_t& entry, int bonus) {
+        entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+    }
+};
+
+struct SearchThread {
+    /**
+     *  @struct SearchThread
+     *  @brief Private state of one Lazy SMP search thread.
+     *
+     ** Every thread searches the same root position on its own copy of the board and only
+     ** shares information with the other threads through the transposition table.
+     *
+     ** The principal variation is kept in a triangular table: pv[ply] holds the best line found
+     ** from that ply on (pv[ply][ply] first, up to pv_length[ply]), and is rebuilt from the child's
+     ** line whenever a move raises alpha.
+     *
+     ** The move made at every ply (and the piece that made it) is kept too, so the move ordering
+     ** can look up the countermove and continuation history of the previous moves.
+    */
+    Board board;
+    int id = 0;                     //* 0 is the main thread, which owns the time management.
+    int ply = 0;                    //* Distance from the root, indexes nnue_stack.
+    int seldepth = 0;               //* Deepest ply reached in the current iteration.
+    std::vector<NNUEdata> nnue_stack = std::vector<NNUEdata>(MAX_PLY + 1); //* One 64-byte aligned accumulator per ply.
+    std::atomic<uint64_t> nodes{0}; //* Only written by its own thread, read by the main thread for "info".
+    Movelist root_moves;            //* Ordered best-first after every completed iteration.
+    int completed_depth = 0;
+    Move best_move = Move::NO_MOVE;
+    Value best_score = VALUE_DRAW;
+    Move pv[MAX_PLY + 1][MAX_PLY + 1];
+    int pv_length[MAX_PLY + 1] = {};
+    std::vector<PvLine> lines;      //* Best root moves of the last completed iteration, best first (MultiPV).
+    Move played_moves[MAX_PLY + 1]; //* The move made at each ply of the current line.
+    Piece moved_pieces[MAX_PLY + 1];    //* Piece::NONE after a null move.
+    Value static_evals[MAX_PLY + 1];    //* Static evaluation at each ply of the current line, VALUE_NONE in check.
+    int null_move_min_ply = 0;          //* Null moves are disabled below this ply during a verification search.
+    std::unique_ptr<SearchHistory> history = std::make_unique<SearchHistory>(); //* About 1.2 MB, kept off the stack.
+
+    int quiet_history(Piece piece, Move move) const;
+
+    void count_node() { this->nodes.store(this->nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    void update_pv(Move move) {
+        /**
+         *  @brief Makes the move followed by the child's line the principal variation of the current ply.
+        */
+        this->pv[this->ply][this->ply] = move;
+        const int child_length = this->pv_length[this->ply + 1];
+        for (int i = this->ply + 1; i < child_length; i++) this->pv[this->ply][i] = this->pv[this->ply + 1][i];
+        this->pv_length[this->ply] = std::max(child_length, this->ply + 1);
+    }
+};
+
 class Bot{
     /**
      *  @class Bot
@@ -257,7 +493,7 @@ class Bot{
      *? Key capabilities:
      *? - Position evaluation via piece-square tables and phase-based heuristics.
      *? - Move selection using minimax/negamax with alpha-beta pruning.
-     *? - Game phase segmentation: opening (using book), middlegame (multi-threaded), endgame (specialized logic).
+     *? - Game phase segmentation: opening (using book), middlegame (Lazy SMP search), endgame (specialized logic).
      *? - Integration with a JSON-formatted opening book file for deterministic early play.
      *? - Logging utilities for diagnostics.
      *
@@ -288,42 +524,58 @@ class Bot{
 
         static void print_board(Board board);
         
-        std::string get_best_move(Board& board, char colour, int depth);
+        std::string get_best_move(Board& board, char colour, const SearchLimits& limits);
         
         static void LogToFile(const std::string& message);
 
-        float stat_eval(Board board, int depth);
+        Value stat_eval(Board board, int depth);
+        std::string get_ponder_move() const;
+
+        inline static std::atomic<bool> stop_search{false}; //* Raised to abort every running search.
+        inline static std::atomic<bool> pondering{false};   //* Time limits are ignored while raised ("go ponder").
+
+        std::function<void(const std::string&)> on_info; //* Receives the UCI "info" lines of the search, if set.
 
     private:
-        json openings_data;
-        PieceTables piece_tables;
+        const EngineResources* resources = &Resources; //* Shared, never owned or modified by the Bot.
         char game_stage = 'o';
-        int piece_values[13] = {1, 3, 3, 5, 9, 100, 1, 3, 3, 5, 9, 100, 0};
+        SearchLimits limits;
+        TimeManager time_manager;
+        std::vector<std::unique_ptr<SearchThread>> search_threads; //* Kept between searches of the same game.
+        Move ponder_move = Move::NO_MOVE;         //* Expected reply to the last best move.
         
-        std::string opening_move(const std::string& fen, char colour);
+        std::string opening_move(const Board& board, char colour);
         std::string middle_game_move(int depth, Board& board, char colour);
         std::string middle_game_x_thread(int depth, Board& board, char colour);
         std::string end_game_move(int depth, Board& board, char colour);
 
         // Helper functions
-        float minimax(int depth, float alpha, float beta, bool maximizing_player, Board& board);
-        float negamax(int depth, float alpha, float beta, Board& board);
+        Value minimax(int depth, Value alpha, Value beta, bool maximizing_player, Board& board);
+        Value negamax(int depth, Value alpha, Value beta, SearchThread& thread);
+        Value quiescence(Value alpha, Value beta, SearchThread& thread, int qs_ply = 0);
         
-        float eval_mid(Board board);
-        float eval_end(Board board);
+        Value eval_tapered(const Board& board);
+        Value evaluate(SearchThread& thread);
         
         // Helpers for the Helpers
-        std::string convert_fen(std::string fen);
-        std::string OpeningBookPath = "includes\\OpeningBook\\book.json";
         
         int determineDepth(const Board& board);
-        int get_random_index(const std::vector<std::string>& vec);
         
-        float search_move(Move move, Board board, int depth, int colour);
-        float calculate_phase(Board board);
+        Value search_root(SearchThread& thread, int depth, Value window_alpha = -VALUE_INFINITE, Value window_beta = VALUE_INFINITE);
+        void iterative_deepening(SearchThread& thread, int max_depth);
+        void report_iteration(const SearchThread& thread, int depth);
+        int calculate_phase(const Board& board);
         
         bool isCheck(Move move, Board& board);
-        bool load_openings_data();
+        bool hasAnyLegalMove(const Board& board);
+        bool should_stop(SearchThread& thread);
+        Move find_ponder_move(const Board& board, Move best_move);
+        void make_move(SearchThread& thread, Move move);
+        void unmake_move(SearchThread& thread, Move move);
+        void make_null_move(SearchThread& thread);
+        void unmake_null_move(SearchThread& thread);
 
-        void order_moves(Movelist& moves, Board& board);
+        void order_moves(Movelist& moves, Board& board, Move tt_move = Move::NO_MOVE);
+        void update_quiet_stats(SearchThread& thread, Move move, int depth, const Movelist& quiets_tried);
+        void order_captures(Movelist& moves, const Board& board);
 };
\ No newline at end of file
@@ -10,8 +10,6 @@
  *? - Identifying tactical motifs such as checks and promotions.
  *? - Determining adaptive search depths based on game complexity.
  *? - Logging state changes and diagnostics to persistent storage.
- *? - Performing basic transformations on game notation (FEN).
- *? - Producing randomized selection indices to add non-determinism.
  *? - Printing the current board visually for debugging or output purposes.
  *
  ** These utilities encapsulate non-core logic to keep evaluation and search code modular
@@ -19,42 +17,49 @@
  ** and contextualize decision-making.
 */
 
-void Bot::order_moves(Movelist& moves, Board& board){
+void Bot::order_moves(Movelist& moves, Board& board, Move tt_move){
     /**
      *  @brief Orders moves heuristically to improve search efficiency.
      *
      *? Scores each move in the given list based on tactical features such as:
-     *? - Castling (encouraged).
-     *? - Captures (prioritized by MVV-LVA).
-     *? - Checks.
-     *? - Promotions.
+     *? - The transposition table move (always searched first).
+     *? - Captures (prioritized by MVV-LVA) and promotions.
+     *? - Checks and castling (encouraged).
      *
      ** The moves are then sorted in descending order of importance and reassigned to the list.
+     ** Used where every move is searched anyway (the root and Bot::minimax()); negamax nodes order
+     ** their moves with the killer, countermove and history tables instead (see MovePicker).
      *
-     *  @param moves  Reference to the list of candidate moves to be ordered.
-     *  @param board  Current board state for evaluating move effects.
+     *  @param moves    Reference to the list of candidate moves to be ordered.
+     *  @param board    Current board state for evaluating move effects.
+     *  @param tt_move  Best move stored in the transposition table for this position, if any.
     */
+    static constexpr int TT_MOVE_SCORE = 1000000;
+    static constexpr int TACTICAL_SCORE = 200000;
+
+    const CheckInfo check_info(board);
     std::vector<std::pair<int, Move>> scored_moves;
     int scores[13] = {1, 3, 3, 5, 9, 10, 1, 3, 3, 5, 9, 10, 0};
     for (const auto& move : moves) {
         int score = 0;
+        const bool capture = board.isCapture(move);
 
-        if (move.typeOf() == Move::CASTLING){
-            score += 100; // prioritise castling
-        } else if (board.isCapture(move)) {
-            Square from = move.from();
-            Square to = move.to();
-            int capturedPiece = board.at(to);
-            int aggressivePiece = board.at(from);
-            score += 950 + (scores[capturedPiece] - scores[aggressivePiece]) * 100;
-        }
-        
-        if (this->isCheck(move, board)) {
-            score += 300; // prioritise checks
+        if (move == tt_move) {
+            score += TT_MOVE_SCORE; // the hash move goes first
         }
 
-        if (move.typeOf() == Move::PROMOTION) {
-            score += 500; // prioritise promotions
+        if (capture || move.typeOf() == Move::PROMOTION) {
+            score += TACTICAL_SCORE;
+            if (capture) {
+                int capturedPiece = board.at(move.to());
+                int aggressivePiece = board.at(move.from());
+                score += 950 + (scores[capturedPiece] - scores[aggressivePiece]) * 100;
+            }
+            if (move.typeOf() == Move::PROMOTION) score += 500; // prioritise promotions
+            if (check_info.gives_check(board, move)) score += 300; // prioritise checks
+        } else {
+            if (move.typeOf() == Move::CASTLING) score += 1000; // prioritise castling
+            if (check_info.gives_check(board, move)) score += 20000; // prioritise checks
         }
         scored_moves.push_back({score, move});
     }
@@ -68,29 +73,126 @@ void Bot::order_moves(Movelist& moves, Board& board){
     }
 }
 
+int SearchThread::quiet_history(Piece piece, Move move) const {
+    /**
+     *  @brief Sums the butterfly and continuation history scores of a quiet move at the current ply.
+     *
+     *  @param piece  The piece making the move.
+     *  @param move   A quiet move of the thread's current position.
+     *  @return The combined score, within ±3 * SearchHistory::MAX_HISTORY.
+    */
+    const SearchHistory& history = *this->history;
+    const int side = static_cast<int>(this->board.sideToMove());
+    const int to = move.to().index();
+    int score = history.butterfly[side][move.from().index()][to];
+
+    for (int back = 1; back <= 2 && back <= this->ply; back++) {
+        const Piece previous = this->moved_pieces[this->ply - back];
+        if (previous == Piece::NONE) continue;
+        score += history.continuation[static_cast<int>(previous)][this->played_moves[this->ply - back].to().index()]
+                                     [static_cast<int>(piece)][to];
+    }
+    return score;
+}
+
+void Bot::update_quiet_stats(SearchThread& thread, Move move, int depth, const Movelist& quiets_tried){
+    /**
+     *  @brief Records a quiet move that caused a beta cutoff in the thread's history tables.
+     *
+     ** The move becomes the first killer of its ply and the countermove of the previous move, and
+     ** its butterfly and continuation history get a depth based bonus. The quiet moves searched
+     ** before it failed to cut off, so they get the same amount as a malus.
+     *
+     *  @param thread       The search thread, at the ply of the cutoff.
+     *  @param move         The quiet move that failed high.
+     *  @param depth        Remaining depth of the node, deeper cutoffs weigh more.
+     *  @param quiets_tried The quiet moves searched before it at this node.
+    */
+    SearchHistory& history = *thread.history;
+    const Board& board = thread.board;
+    const int ply = thread.ply;
+
+    if (history.killers[ply][0] != move) {
+        history.killers[ply][1] = history.killers[ply][0];
+        history.killers[ply][0] = move;
+    }
+    if (ply > 0 && thread.moved_pieces[ply - 1] != Piece::NONE) {
+        history.countermoves[static_cast<int>(thread.moved_pieces[ply - 1])][thread.played_moves[ply - 1].to().index()] = move;
+    }
+
+    const int bonus = std::min(32 * depth * depth + 64 * depth, 1536);
+    const int side = static_cast<int>(board.sideToMove());
+    auto update = [&](Move quiet, int amount) {
+        const int piece = static_cast<int>(board.at(quiet.from()));
+        const int to = quiet.to().index();
+        SearchHistory::update(history.butterfly[side][quiet.from().index()][to], amount);
+        for (int back = 1; back <= 2 && back <= ply; back++) {
+            const Piece previous = thread.moved_pieces[ply - back];
+            if (previous == Piece::NONE) continue;
+            SearchHistory::update(history.continuation[static_cast<int>(previous)][thread.played_moves[ply - back].to().index()][piece][to], amount);
+        }
+    };
+
+    update(move, bonus);
+    for (const auto& quiet : quiets_tried) update(quiet, -bonus);
+}
+
+void Bot::order_captures(Movelist& moves, const Board& board){
+    /**
+     *  @brief Orders captures by MVV-LVA (most valuable victim, least valuable attacker).
+     *
+     ** A cheaper alternative to Bot::order_moves() for the quiescence search, where every move
+     ** is a capture (or promotion) and the check test would dominate the cost of ordering.
+     *
+     *  @param moves  Reference to the list of captures to be ordered.
+     *  @param board  Current board state.
+    */
+    for (auto& move : moves) {
+        //* En passant lands on an empty square but always captures a pawn.
+        PieceType victim = move.typeOf() == Move::ENPASSANT ? PieceType(PieceType::PAWN) : board.at<PieceType>(move.to());
+        PieceType attacker = board.at<PieceType>(move.from());
+        int score = victim == PieceType::NONE ? 0 : (static_cast<int>(victim) + 1) * 16 - static_cast<int>(attacker);
+        if (move.typeOf() == Move::PROMOTION) score += (static_cast<int>(move.promotionType()) + 1) * 16;
+        move.setScore(static_cast<int16_t>(score));
+    }
+    std::stable_sort(moves.begin(), moves.end(), [](const Move& a, const Move& b) {
+        return a.score() > b.score();
+    });
+}
+
 bool Bot::isCheck(Move move, Board& board) {
     /**
      *  @brief Determines if a given move results in a check.
      *
-     ** Temporarily applies the move, then checks if the opposing king becomes attacked.
-     ** The move is reverted after evaluation to preserve board state.
+     ** Tests the move against the check squares and discovered check blockers of the position
+     ** (see CheckInfo), without playing it. When testing many moves of the same position, build
+     ** one CheckInfo and reuse it instead, as Bot::order_moves() does.
      *
      *  @param move   Move to evaluate.
      *  @param board  Current board state.
      *  @return true if the move results in a check, false otherwise.
     */
-    Color stm = board.sideToMove();
-    int square = 0;
-    if (stm == Color(0)) {
-        square = board.pieces(PieceType("KING"), Color(1)).lsb();
-    } else {
-        square = board.pieces(PieceType("KING"), Color(0)).lsb();
-    }
-    Square king(square);
-    board.makeMove(move);
-    bool is_check = board.isAttacked(king, stm);
-    board.unmakeMove(move);
-    return is_check;
+    return CheckInfo(board).gives_check(board, move);
+}
+
+bool Bot::hasAnyLegalMove(const Board& board) {
+    /**
+     *  @brief Determines if the side to move has at least one legal move, without generating them all.
+     *
+     ** Generates the legal moves one group of piece types at a time and stops at the first group
+     ** that has any. Pawns and knights are tried first since they almost always can move and need
+     ** no attacked-squares map; the king, which does, is next, and the sliders last.
+     *
+     *  @param board  Current board state.
+     *  @return false if the position is checkmate or stalemate, true otherwise.
+    */
+    Movelist moves;
+    movegen::legalmoves(moves, board, PieceGenType::PAWN | PieceGenType::KNIGHT);
+    if (!moves.empty()) return true;
+    movegen::legalmoves(moves, board, PieceGenType::KING);
+    if (!moves.empty()) return true;
+    movegen::legalmoves(moves, board, PieceGenType::BISHOP | PieceGenType::ROOK | PieceGenType::QUEEN);
+    return !moves.empty();
 }
 
 int Bot::determineDepth(const Board& board) {
@@ -143,73 +245,22 @@ void Bot::LogToFile(const std::string& message) {
     outfile << message << std::endl;
 }
 
-float Bot::calculate_phase(Board board){
+int Bot::calculate_phase(const Board& board){
     /**
      *  @brief Calculates the current phase of the game (opening, middlegame, or endgame).
      *
      ** Uses a weighted material-based phase model where fewer heavy pieces indicate
-     ** transition to the endgame. Scales the result to a 0–256 range.
+     ** transition to the endgame. Scales the result to a 0–256 range, using the same
+     ** weights as Bot::eval_tapered().
      *
      *  @param board  Current board state.
-     *  @return Phase value (0 = endgame, 256 = opening).
+     *  @return Phase value (0 = opening, 256 = endgame).
     */
-
-    float phase;
-    float PawnPhase = 0;
-    float KnightPhase = 1;
-    float BishopPhase = 1;
-    float RookPhase = 2;
-    float QueenPhase = 4;
-    float TotalPhase = PawnPhase*16 + KnightPhase*4 + BishopPhase*4 + RookPhase*4 + QueenPhase*2;
-
-    phase = TotalPhase;
-
-    phase -= board.pieces(PieceType::PAWN).count() * PawnPhase;
-    phase -= board.pieces(PieceType::KNIGHT).count() * KnightPhase;
-    phase -= board.pieces(PieceType::BISHOP).count() * BishopPhase;
-    phase -= board.pieces(PieceType::ROOK).count() * RookPhase;
-    phase -= board.pieces(PieceType::QUEEN).count() * QueenPhase;
-
-    phase = (phase * 256 + (TotalPhase / 2)) / TotalPhase;
-    return phase;
-}
-
-std::string Bot::convert_fen(std::string fen) {
-    /**
-     *  @brief Converts a full FEN string to a simplified version used internally.
-     *
-     ** Trims trailing data such as halfmove clocks and fullmove numbers to isolate
-     ** board and turn representation.
-     *
-     *  @param fen  The full FEN string.
-     *  @return Trimmed FEN string for use in hashing or evaluation.
-    */
-    std::string converted_fen;
-    converted_fen = fen.erase(fen.length() - 4, 4);
-    return converted_fen;
-}
-
-int Bot::get_random_index(const std::vector<std::string>& vec){
-    /**
-     *  @brief Selects a random index from a given vector.
-     *
-     ** Used for randomized behavior such as picking between equally viable moves.
-     ** Logs a warning and returns 0 if the input vector is empty.
-     *
-     *  @param vec  Input vector of strings.
-     *  @return Random index from vec, or 0 if vec is empty.
-    */
-    if (vec.empty()) {
-        std::cerr << "Warning: Vector is empty. Returning 0." << std::endl;
-        return 0;
+    int material = 0;
+    for (int type = 0; type < 6; type++) {
+        material += board.pieces(PieceType(static_cast<PieceType::underlying>(type))).count() * PHASE_WEIGHTS[type];
     }
-
-    static std::random_device rd; // Static for persistent engine
-    static std::mt19937 gen(rd());  // Static for persistent engine
-
-    std::uniform_int_distribution<> distrib(0, vec.size() - 1);
-    return distrib(gen);
-
+    return phase_from_material(material);
 }
 
 void Bot::print_board(Board board) {
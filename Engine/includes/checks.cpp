@@ -0,0 +1,157 @@
+/**
+ *  @file checks.cpp
+ *  @brief Implements gives-check detection without playing the move.
+ *
+ ** Move ordering wants to know which moves give check, and making and unmaking every candidate
+ ** move just to test whether the enemy king is attacked doubled the make/unmake traffic of every
+ ** node. Instead, CheckInfo collects once per node everything a check depends on, after which
+ ** testing a move is a couple of bitboard operations:
+ *
+ *? - check squares: for every piece type, the squares from which it would attack the enemy king
+ *?   (the attacks of that piece type from the king's square).
+ *? - discovered check blockers: the side to move's pieces standing alone between one of its
+ *?   sliders and the enemy king. Moving one off that line uncovers the slider.
+ *
+ ** Castling and en passant change more than two squares and are tested on the resulting
+ ** occupancy instead; they are rare enough that this costs nothing.
+ *
+ *! @note chess.hpp keeps its squares-between table private, so the between/line tables used here
+ *!       are built once from chess::attacks on first use.
+*/
+
+struct LineTables {
+    /**
+     *  @struct LineTables
+     *  @brief Squares between and squares on the line through every aligned pair of squares.
+    */
+    Bitboard between[64][64];   //* Squares strictly between a and b, empty if not aligned.
+    Bitboard line[64][64];      //* The whole rank, file or diagonal through a and b, empty if not aligned.
+
+    LineTables() {
+        for (int a = 0; a < 64; a++) {
+            for (int b = 0; b < 64; b++) {
+                const Square sa(a), sb(b);
+                if (a == b) continue;
+                if (attacks::rook(sa, Bitboard(0)) & Bitboard::fromSquare(sb)) {
+                    this->between[a][b] = attacks::rook(sa, Bitboard::fromSquare(sb)) & attacks::rook(sb, Bitboard::fromSquare(sa));
+                    this->line[a][b] = (attacks::rook(sa, Bitboard(0)) & attacks::rook(sb, Bitboard(0)))
+                                     | Bitboard::fromSquare(sa) | Bitboard::fromSquare(sb);
+                } else if (attacks::bishop(sa, Bitboard(0)) & Bitboard::fromSquare(sb)) {
+                    this->between[a][b] = attacks::bishop(sa, Bitboard::fromSquare(sb)) & attacks::bishop(sb, Bitboard::fromSquare(sa));
+                    this->line[a][b] = (attacks::bishop(sa, Bitboard(0)) & attacks::bishop(sb, Bitboard(0)))
+                                     | Bitboard::fromSquare(sa) | Bitboard::fromSquare(sb);
+                }
+            }
+        }
+    }
+};
+
+inline const LineTables& line_tables() {
+    static const LineTables tables; //* Built on first use, after chess.hpp's attack tables.
+    return tables;
+}
+
+struct CheckInfo {
+    /**
+     *  @struct CheckInfo
+     *  @brief Per-node data that turns "does this move give check?" into a bitboard test.
+    */
+    Square king;                    //* The enemy king.
+    Bitboard occupied;
+    Bitboard check_squares[6];      //* By PieceType of the moving piece; always empty for the king.
+    Bitboard blockers;              //* Own pieces whose move can uncover a check.
+
+    explicit CheckInfo(const Board& board);
+    bool gives_check(const Board& board, Move move) const;
+
+    private:
+        Bitboard slider_checks(const Board& board, Bitboard occupied) const;
+};
+
+CheckInfo::CheckInfo(const Board& board) {
+    /**
+     *  @brief Collects the check squares and discovered check blockers of the side to move.
+     *
+     *  @param board The position the moves will be played from.
+    */
+    const Color us = board.sideToMove();
+    this->king = board.kingSq(~us);
+    this->occupied = board.occ();
+
+    this->check_squares[static_cast<int>(PieceType::PAWN)] = attacks::pawn(~us, this->king);
+    this->check_squares[static_cast<int>(PieceType::KNIGHT)] = attacks::knight(this->king);
+    this->check_squares[static_cast<int>(PieceType::BISHOP)] = attacks::bishop(this->king, this->occupied);
+    this->check_squares[static_cast<int>(PieceType::ROOK)] = attacks::rook(this->king, this->occupied);
+    this->check_squares[static_cast<int>(PieceType::QUEEN)] = this->check_squares[static_cast<int>(PieceType::BISHOP)]
+                                                            | this->check_squares[static_cast<int>(PieceType::ROOK)];
+    this->check_squares[static_cast<int>(PieceType::KING)] = Bitboard(0);
+
+    const Bitboard queens = board.pieces(PieceType::QUEEN, us);
+    Bitboard snipers = (attacks::bishop(this->king, Bitboard(0)) & (board.pieces(PieceType::BISHOP, us) | queens))
+                     | (attacks::rook(this->king, Bitboard(0)) & (board.pieces(PieceType::ROOK, us) | queens));
+
+    const LineTables& tables = line_tables();
+    this->blockers = Bitboard(0);
+    while (snipers) {
+        const Bitboard between = tables.between[snipers.pop()][this->king.index()] & this->occupied;
+        if (between.count() == 1) this->blockers |= between & board.us(us);
+    }
+}
+
+Bitboard CheckInfo::slider_checks(const Board& board, Bitboard occupied) const {
+    /**
+     *  @brief The side to move's sliders that attack the enemy king for the given occupancy.
+    */
+    const Color us = board.sideToMove();
+    const Bitboard queens = board.pieces(PieceType::QUEEN, us);
+    return (attacks::bishop(this->king, occupied) & (board.pieces(PieceType::BISHOP, us) | queens))
+         | (attacks::rook(this->king, occupied) & (board.pieces(PieceType::ROOK, us) | queens));
+}
+
+bool CheckInfo::gives_check(const Board& board, Move move) const {
+    /**
+     *  @brief Determines if a legal move of the side to move checks the enemy king.
+     *
+     *  @param board The position the CheckInfo was built for.
+     *  @param move  A legal move in that position.
+     *  @return true if the move results in a check, false otherwise.
+    */
+    const Square from = move.from();
+    const Square to = move.to();
+    const Bitboard from_bb = Bitboard::fromSquare(from);
+    const Bitboard to_bb = Bitboard::fromSquare(to);
+
+    if (move.typeOf() == Move::CASTLING) {
+        //* Encoded as "king takes own rook": only the rook can give check.
+        const Color us = board.sideToMove();
+        const bool king_side = to.index() > from.index();
+        const Square king_to = Square::castling_king_square(king_side, us);
+        const Square rook_to = Square::castling_rook_square(king_side, us);
+        const Bitboard occupied = (this->occupied ^ from_bb ^ to_bb) | Bitboard::fromSquare(king_to) | Bitboard::fromSquare(rook_to);
+        return static_cast<bool>(attacks::rook(this->king, occupied) & Bitboard::fromSquare(rook_to));
+    }
+
+    const PieceType piece = board.at<PieceType>(from);
+    if (move.typeOf() != Move::PROMOTION && (this->check_squares[static_cast<int>(piece)] & to_bb)) return true;
+
+    //* Discovered check, unless the piece stays on the line between the slider and the king.
+    if ((this->blockers & from_bb) && !(line_tables().line[from.index()][this->king.index()] & to_bb)) return true;
+
+    if (move.typeOf() == Move::PROMOTION) {
+        const Bitboard occupied = this->occupied ^ from_bb;
+        switch (static_cast<int>(move.promotionType())) {
+            case static_cast<int>(PieceType::KNIGHT): return static_cast<bool>(attacks::knight(to) & Bitboard::fromSquare(this->king));
+            case static_cast<int>(PieceType::BISHOP): return static_cast<bool>(attacks::bishop(to, occupied) & Bitboard::fromSquare(this->king));
+            case static_cast<int>(PieceType::ROOK):   return static_cast<bool>(attacks::rook(to, occupied) & Bitboard::fromSquare(this->king));
+            default:                                  return static_cast<bool>(attacks::queen(to, occupied) & Bitboard::fromSquare(this->king));
+        }
+    }
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        //* The captured pawn leaves its square too, which can open a line to the king.
+        const Square captured(to.file(), from.rank());
+        const Bitboard occupied = (this->occupied ^ from_bb ^ Bitboard::fromSquare(captured)) | to_bb;
+        return static_cast<bool>(this->slider_checks(board, occupied));
+    }
+    return false;
+}
@@ -4,7 +4,9 @@
  *
  ** This file implements multiple constructors for the Bot class, which initialise
  ** a chess game state using a FEN string and determine the initial game stage.
- ** If loading opening book data fails, the bot transitions directly to midgame.
+ ** If the shared opening book (see resources.cpp) is not loaded, the bot transitions
+ ** directly to midgame. Constructing a Bot loads nothing, so it is cheap enough to do for
+ ** every game and position.
 */
 
 #include "bot.h"
@@ -14,13 +16,13 @@ Bot::Bot() {
      * @brief Default constructor for the Bot class.
      *
      ** Initializes the bot's internal chess board to the standard starting position using FEN notation.
-     ** Sets the initial game stage to opening ('o'). If the opening book fails to load,
+     ** Sets the initial game stage to opening ('o'). If the shared opening book is not loaded,
      ** the game stage is immediately set to midgame ('m').
     */
     
     this->board.setFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
     this->game_stage = 'o';
-    if (!this->load_openings_data()) {
+    if (this->resources->opening_book.empty()) {
         this->game_stage = 'm';
     }
 }
@@ -31,14 +33,14 @@ Bot::Bot(std::string fen) {
      *
      ** Initialises the bot's internal board using the given FEN string, allowing setup of
      ** custom positions or non-standard starting states. Sets the initial game stage to opening ('o').
-     ** If the opening book fails to load, the game stage defaults to midgame ('m').
+     ** If the shared opening book is not loaded, the game stage defaults to midgame ('m').
      *
      *  @param fen A Forsyth–Edwards Notation (FEN) string representing the desired initial board state.
     */
     
     this->board.setFen(fen);
     this->game_stage = 'o';
-    if (!this->load_openings_data()) {
+    if (this->resources->opening_book.empty()) {
         this->game_stage = 'm';
     }
 }
@@ -49,7 +51,7 @@ Bot::Bot(std::string fen, char game_stage) {
      *
      ** Initialises the bot's internal board using the provided FEN string and sets the
      ** game stage explicitly. This allows customised initialisation for different
-     ** scenarios (e.g., opening, midgame, or endgame). If the opening book fails to load,
+     ** scenarios (e.g., opening, midgame, or endgame). If the shared opening book is not loaded,
      ** the stage is overridden to midgame ('m') to reflect the lack of opening data.
      *
      *  @param fen A Forsyth–Edwards Notation (FEN) string representing the initial board state.
@@ -57,7 +59,7 @@ Bot::Bot(std::string fen, char game_stage) {
     */
     this->board.setFen(fen);
     this->game_stage = game_stage;
-    if (game_stage == 'o' && !this->load_openings_data()) {
+    if (game_stage == 'o' && this->resources->opening_book.empty()) {
         this->game_stage = 'm';
     }
 }
\ No newline at end of file
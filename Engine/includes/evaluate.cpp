@@ -8,198 +8,130 @@
  ** endgame evaluation tailored for different strategic priorities. These scores are used
  ** by the engine to make decisions and compare candidate moves.
  *
- ** The evaluation pipeline leverages asynchronous computation to calculate endgame
- ** evaluations concurrently with midgame analysis, improving overall performance.
+ ** The handcrafted evaluation is a single pass over the piece bitboards: midgame and endgame
+ ** scores are packed into one integer per piece-square entry and accumulated together, and the
+ ** game phase is derived from the same piece counts. It runs on the calling search thread and
+ ** never copies the board.
 */
 
+#include "nnue_eval.cpp"
 
-float Bot::eval_mid(Board board){
+
+constexpr PackedScore make_score(int mg, int eg) {
+    return static_cast<PackedScore>(static_cast<uint32_t>(eg) << 16) + mg;
+}
+
+inline int mg_value(PackedScore score) {
+    return static_cast<int16_t>(static_cast<uint16_t>(static_cast<uint32_t>(score)));
+}
+
+inline int eg_value(PackedScore score) {
+    return static_cast<int16_t>(static_cast<uint16_t>((static_cast<uint32_t>(score) + 0x8000) >> 16));
+}
+
+//* Game phase weights per piece type (pawn, knight, bishop, rook, queen, king).
+constexpr int PHASE_WEIGHTS[6] = {0, 1, 1, 2, 4, 0};
+constexpr int TOTAL_PHASE = 4 * PHASE_WEIGHTS[1] + 4 * PHASE_WEIGHTS[2] + 4 * PHASE_WEIGHTS[3] + 2 * PHASE_WEIGHTS[4];
+
+inline int phase_from_material(int material) {
     /**
-     * @brief Evaluates the board state during the midgame phase.
-     *
-     ** Calculates the midgame positional score based on piece-square tables for both sides.
-     ** Launches an asynchronous evaluation of the endgame using Bot::eval_end(), and blends the result
-     ** based on the current game phase (calculated by Bot::calculate_phase()) for a smooth transition
-     ** between midgame and endgame heuristics.
-     *
-     *  @param board The current game board to evaluate.
-     *  @return A floating-point score representing the evaluation from white's perspective
-     *          (positive = advantage to white, negative = advantage to black).
+     *  @brief Converts the remaining phase material into a 0 (opening) to 256 (endgame) phase.
     */
-    int score = 0;
-
-    Square sq;
+    int phase = ((TOTAL_PHASE - material) * 256 + TOTAL_PHASE / 2) / TOTAL_PHASE;
+    return std::max(0, std::min(phase, 256)); //! Promotions can push the material above the starting total.
+}
 
-    std::future<float> future_result = std::async(std::launch::async, &Bot::eval_end, this, board);
+PackedPieceTables::PackedPieceTables(const PieceTables& tables) {
+    /**
+     *  @brief Merges the midgame and endgame PieceTables into signed packed scores.
+     *
+     ** In the endgame knights, bishops, rooks and queens use fixed values instead of a table.
+    */
+    const int (*mid[12])[8] = {tables.w_pawn, tables.w_knight, tables.w_bishop, tables.w_rook, tables.w_queen, tables.w_king_mid,
+                               tables.b_pawn, tables.b_knight, tables.b_bishop, tables.b_rook, tables.b_queen, tables.b_king_mid};
+    const int (*end[12])[8] = {tables.w_pawn_end, nullptr, nullptr, nullptr, nullptr, tables.w_king_end,
+                               tables.b_pawn_end, nullptr, nullptr, nullptr, nullptr, tables.b_king_end};
+    static constexpr int END_VALUES[6] = {0, 300, 300, 500, 900, 0};
 
-    for (int rank = 0; rank < 8; ++rank) {
-        for (int file = 0; file < 8; ++file) {
-            sq = Square(rank * 8 + file);
-            switch (board.at(sq)){
-                case 12:
-                    // Nothing
-                    break;
-                case 0:
-                    // White Pawn
-                    score += this->piece_tables.w_pawn[rank][file];
-                    break;
-                case 1:
-                    // White Knight
-                    score += this->piece_tables.w_knight[rank][file];
-                    break;
-                case 2:
-                    // White Bishop
-                    score += this->piece_tables.w_bishop[rank][file];
-                    break;
-                case 3:
-                    // White Rook
-                    score += this->piece_tables.w_rook[rank][file];
-                    break;
-                case 4:
-                    // White Queen
-                    score += this->piece_tables.w_queen[rank][file];
-                    break;
-                case 5:
-                    // White King
-                    score += this->piece_tables.w_king_mid[rank][file];
-                    break;
-                case 6:
-                    // Black Pawn
-                    score -= this->piece_tables.b_pawn[rank][file];
-                    break;
-                case 7:
-                    // Black Knight
-                    score -= this->piece_tables.b_knight[rank][file];
-                    break;
-                case 8:
-                    // Black Bishop
-                    score -= this->piece_tables.b_bishop[rank][file];
-                    break;
-                case 9:
-                    // Black Rook
-                    score -= this->piece_tables.b_rook[rank][file];
-                    break;
-                case 10:
-                    // Black Queen
-                    score -= this->piece_tables.b_queen[rank][file];
-                    break;
-                case 11:
-                    // Black King
-                    score -= this->piece_tables.b_king_mid[rank][file];
-                    break;
-                default:
-                    std::cout << "Error" << std::endl;
-                    break;
-            }
+    for (int piece = 0; piece < 12; piece++) {
+        const int sign = piece < 6 ? 1 : -1;
+        for (int sq = 0; sq < 64; sq++) {
+            const int mg = mid[piece][sq / 8][sq % 8];
+            const int eg = end[piece] ? end[piece][sq / 8][sq % 8] : END_VALUES[piece % 6];
+            this->psqt[piece][sq] = make_score(sign * mg, sign * eg);
         }
     }
-    float end_eval = future_result.get() * 100.0f;
-    float phase = Bot::calculate_phase(board);
-    float eval = ((score * (256 - phase)) + (end_eval * phase)) / 256;
-    return eval/100.0f;
 }
 
-float Bot::eval_end(Board board){
+Value Bot::eval_tapered(const Board& board){
     /**
-     *  @brief Evaluates the board state during the endgame phase.
+     *  @brief Handcrafted evaluation blending midgame and endgame piece-square scores.
      *
-     ** Calculates a simplified endgame score by combining fixed piece values and endgame
-     ** piece-square tables. Emphasises king and pawn positioning, while assigning static values
-     ** to other pieces to reflect their strategic utility in the late game.
+     ** Walks every piece bitboard once, accumulating the packed midgame/endgame scores and the
+     ** phase material together. The two scores are then blended by the game phase for a smooth
+     ** transition between midgame and endgame heuristics. Used by Bot::minimax() and as the
+     ** fallback for Bot::evaluate() when no NNUE network is loaded.
      *
      *  @param board The current game board to evaluate.
-     *  @return A floating-point score representing the evaluation from white's perspective
+     *  @return A score in centipawns from white's perspective
      *          (positive = advantage to white, negative = advantage to black).
     */
+    PackedScore score = 0;
+    int material = 0;
 
-    int score = 0;
+    for (int color = 0; color < 2; color++) {
+        for (int type = 0; type < 6; type++) {
+            Bitboard pieces = board.pieces(PieceType(static_cast<PieceType::underlying>(type)), Color(color));
+            const PackedScore* table = this->resources->packed_tables.psqt[color * 6 + type];
+            material += pieces.count() * PHASE_WEIGHTS[type];
+            while (pieces) score += table[pieces.pop()];
+        }
+    }
 
-    Square sq;
+    const int phase = phase_from_material(material);
+    return static_cast<Value>((mg_value(score) * (256 - phase) + eg_value(score) * phase) / 256);
+}
 
-    for (int rank = 0; rank < 8; ++rank) {
-        for (int file = 0; file < 8; ++file) {
-            sq = Square(rank * 8 + file);
-            // As the game gets towards the end of the game, the value of the pieces change
-            // They no longer have 'bad' squares except for the king and the pawns. The other
-            // pieces should just support these pieces and help them promote.
-            switch (board.at(sq)){
-                case 12:
-                    // Nothing
-                    break;
-                case 0:
-                    // White Pawn
-                    score += this->piece_tables.w_pawn_end[rank][file];
-                    break;
-                case 1:
-                    // White Knight
-                    score += 300;
-                    break;
-                case 2:
-                    // White Bishop
-                    score += 300;
-                    break;
-                case 3:
-                    // White Rook
-                    score += 500;
-                    break;
-                case 4:
-                    // White Queen
-                    score += 900;
-                    break;
-                case 5:
-                    // White King
-                    score += this->piece_tables.w_king_end[rank][file];
-                    break;
-                case 6:
-                    // Black Pawn
-                    score -= this->piece_tables.b_pawn_end[rank][file];
-                    break;
-                case 7:
-                    // Black Knight
-                    score -= 300;
-                    break;
-                case 8:
-                    // Black Bishop
-                    score -= 300;
-                    break;
-                case 9:
-                    // Black Rook
-                    score -= 500;
-                    break;
-                case 10:
-                    // Black Queen
-                    score -= 900;
-                    break;
-                case 11:
-                    // Black King
-                    score -= this->piece_tables.b_king_end[rank][file];
-                    break;
-                default:
-                    std::cout << "Error" << std::endl;
-                    break;
-            }
-        }
+Value Bot::evaluate(SearchThread& thread){
+    /**
+     *  @brief Static evaluation of the thread's current position for the search.
+     *
+     ** Uses the incremental NNUE accumulator stack when a network is loaded, and the handcrafted
+     ** Bot::eval_tapered() otherwise. The handcrafted score is halved to match the NNUE scale
+     ** (network centipawns / 2) the search margins are tuned for. The result is kept out of the
+     ** mate range, so a static evaluation can never be mistaken for a mate score.
+     *
+     *  @param thread The search thread whose board holds the position.
+     *  @return The evaluation in centipawns from the side to move's perspective.
+    */
+    int eval;
+    if (nnue_loaded()) {
+        eval = evaluate_nnue_incremental(thread.board, thread.nnue_stack.data(), thread.ply);
+    } else {
+        eval = this->eval_tapered(thread.board) / 2;
+        if (thread.board.sideToMove() == Color::BLACK) eval = -eval;
     }
-    
-    return score/100.0f;
+    return static_cast<Value>(std::max(VALUE_MATED_IN_MAX_PLY + 1, std::min(eval, VALUE_MATE_IN_MAX_PLY - 1)));
 }
 
-float Bot::stat_eval(Board board, int depth=-1) {
+Value Bot::stat_eval(Board board, int depth=-1) {
     /**
      *  @brief Static evaluation function for the board.
      *
-     ** This function evaluates the board state using a combination of midgame and endgame evaluations,
-     ** depending on the current game phase. It uses Bot::eval_mid() and Bot::eval_end() to get the scores
-     ** and blends them based on the phase of the game.
+     ** Runs a negamax search of the given depth (a plain quiescence search by default) from the
+     ** board, so the result uses the same evaluation as the engine's search (see Bot::evaluate()).
      *
      *  @param board The current game board to evaluate.
-     *  @param depth The search depth (not used in this static evaluation).
-     *  @return A floating-point score representing the evaluation from white's perspective
-     *          (positive = advantage to white, negative = advantage to black).
+     *  @param depth The search depth (-1 for only the quiescence search).
+     *  @return The score in centipawns from the side to move's perspective (or a mate score, see Value).
     */
 
+    Bot::stop_search = false;
+    this->time_manager = TimeManager();
+    SearchThread thread;
+    thread.board = board;
     if (depth != -1){
-        return this->negamax(depth, -1000000.0f, 1000000.0f, board);
+        return this->negamax(depth, -VALUE_INFINITE, VALUE_INFINITE, thread);
     }
-    return this->negamax(0, -1000000.0f, 1000000.0f, board);
+    return this->negamax(0, -VALUE_INFINITE, VALUE_INFINITE, thread);
 }
\ No newline at end of file
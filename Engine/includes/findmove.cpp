@@ -3,78 +3,228 @@
  *  @brief Implements move search algorithms for the Bot class during the midgame phase.
  *
  ** This file provides threaded and sequential strategies to determine the best move
- ** using evaluation heuristics and search algorithms. The threaded version evaluates
- ** all legal moves in parallel to improve performance on multi-core systems, while
- ** the single-threaded version uses minimax with alpha-beta pruning.
+ ** using evaluation heuristics and search algorithms. The threaded version is a Lazy SMP
+ ** search: a configurable number of threads ("Threads" option) iteratively deepen the same
+ ** root position and share their work through the transposition table, while the
+ ** single-threaded version uses minimax with alpha-beta pruning.
  *
  **  The results are returned in UCI (Universal Chess Interface) format for compatibility.
 */
 
 
+void Bot::iterative_deepening(SearchThread& thread, int max_depth){
+    /**
+     *  @brief Runs the iterative deepening loop of a single Lazy SMP search thread.
+     *
+     ** Searches the root to depths 1, 2, ... max_depth, recording the best move of every completed
+     ** iteration in the thread. Helper threads (id > 0) are perturbed so they do not duplicate the
+     ** main thread's work: odd helpers search one ply deeper than the main thread, and every helper
+     ** starts from a differently rotated root move order. The results they leave in the shared
+     ** transposition table then speed up (and reorder) the other threads' searches.
+     *
+     ** From depth 4 on, every iteration starts with an aspiration window around the previous
+     ** iteration's score: most iterations land inside it and the narrow window prunes much more.
+     ** When the score falls outside, the window is widened on that side (growing by half each time)
+     ** and the iteration is searched again. MultiPV searches and mate scores use a full window.
+     *
+     ** Only the main thread (id 0) looks at the soft time limit, and only once pondering is over;
+     ** helpers run until Bot::stop_search is raised. The main thread also reports every completed
+     ** iteration (see Bot::report_iteration()).
+     *
+     *  @param thread    The search thread (its board must hold the root position).
+     *  @param max_depth The deepest iteration the main thread may start.
+    */
+
+    int depth_offset = thread.id & 1;
+    int moves_count = thread.root_moves.size();
+    if (thread.id > 0 && moves_count > 1) {
+        //* Keep the best-ordered move first and rotate the rest by the thread id.
+        std::rotate(thread.root_moves.begin() + 1,
+                    thread.root_moves.begin() + 1 + thread.id % (moves_count - 1),
+                    thread.root_moves.end());
+    }
+
+    static constexpr int ASPIRATION_DEPTH = 4;
+    static constexpr int ASPIRATION_DELTA = 25;
+
+    for (int current_depth = 1; current_depth <= max_depth; current_depth++) {
+        int depth = std::min(current_depth + depth_offset, MAX_DEPTH);
+        thread.seldepth = 0;
+
+        int alpha = -VALUE_INFINITE;
+        int beta = VALUE_INFINITE;
+        int delta = ASPIRATION_DELTA;
+        const int previous = thread.best_score;
+        if (current_depth >= ASPIRATION_DEPTH && this->limits.multi_pv <= 1 && !is_mate_score(previous)) {
+            alpha = std::max(previous - delta, -VALUE_INFINITE);
+            beta = std::min(previous + delta, VALUE_INFINITE);
+        }
+        while (true) {
+            const int score = this->search_root(thread, depth, alpha, beta);
+            if (Bot::stop_search) break;
+            if (score <= alpha) {
+                beta = (alpha + beta) / 2;
+                alpha = std::max(score - delta, -VALUE_INFINITE);
+            } else if (score >= beta) {
+                beta = std::min(score + delta, VALUE_INFINITE);
+            } else {
+                break;
+            }
+            delta += delta / 2;
+        }
+
+        if (Bot::stop_search) break; //* Incomplete iteration, keep the previous result.
+        thread.completed_depth = depth;
+        if (thread.id == 0) this->report_iteration(thread, depth);
+
+        if (thread.id == 0 && !Bot::pondering && this->time_manager.soft_limit_reached()) break;
+    }
+}
+
 std::string Bot::middle_game_x_thread(int depth, Board& board, char colour){
     /**
-     *  @brief Performs multithreaded evaluation to find the best midgame move.
+     *  @brief Performs a Lazy SMP iteratively deepened search to find the best midgame move.
+     *
+     ** Submits one helper search per extra worker of the shared pool ("Threads" option) and runs
+     ** the main search on the calling thread.
+     ** Every thread searches the whole root position on its own board copy (see
+     ** Bot::iterative_deepening()) and the threads only cooperate through the shared
+     ** transposition table, so no locking is needed.
      *
-     ** Generates all legal moves for the current board state and evaluates each one concurrently
-     ** in separate threads using the Bot::search_move() function. Results are stored in a vector and
-     ** sorted based on evaluation score. The move with the highest score is returned in UCI format.
+     ** Once the main thread finishes (requested depth reached, soft or hard time limit passed) it
+     ** raises Bot::stop_search and waits for the helpers. The main thread's move is played unless
+     ** a helper completed a deeper iteration. The expected reply (the second move of its principal
+     ** variation) is kept for "bestmove ... ponder".
      *
-     *? Thread safety is ensured using a mutex when updating shared results data.
+     ** The search threads belong to the Bot and are reused by every search of the game, so their
+     ** buffers (such as the NNUE accumulator stacks) are only allocated once. Only the per-search
+     ** fields are reset here. The history tables carry over too: they age by themselves (see SearchHistory).
      *
-     *  @param depth The search depth for each move evaluation.
+     *  @param depth The maximum search depth of the main thread.
      *  @param board The board to evaluate.
      *  @param colour The side to move ('w' for white, 'b' for black).
-     *  @return The best move in UCI format as a std::string.
+     *  @return The best move in UCI format as a std::string ("0000" if there are no legal moves).
     */
 
     Movelist moves = Movelist();
     movegen::legalmoves(moves, board);
-    order_moves(moves, board);
-    
-    float evaluation;
-    Move move = Move();
+    if (moves.empty()) return "0000";
+    TTData tt_data;
+    order_moves(moves, board, TT.probe(board.hash(), tt_data) ? tt_data.move : Move::NO_MOVE);
 
-    //? If there are significant slowdowns, consider using a fixed number of threads instead of one per move.
-    const int num_iterations = moves.size(); 
-    std::vector<std::thread> threads;
-    std::vector<std::pair<double, std::string>> data(num_iterations); // Vector to store results and moves
-    std::mutex results_mutex; // Mutex to protect access to the results vector. //!IMPORTANT!
-
-    // Create and start a thread for each iteration.
-    for (int i = 0; i < num_iterations; ++i) {
-        threads.emplace_back(
-            // Use a lambda function to capture 'i' by value and handle the result.
-            [&, i]() {
-                float result = this->search_move(moves[i], board, depth, 1); // Calculate the result
-                // Use a lock_guard to ensure thread-safe access to the results vector.
-                std::lock_guard<std::mutex> guard(results_mutex);
-                data[i].first = result; // Store the result in the correct position.
-                data[i].second = uci::moveToUci(moves[i]); // Store the move in the correct position.
-            }
-        );
-        // std::cout << "Thread " << threads.back().get_id() << " started for iteration " << i << std::endl;
+    const int thread_count = Pool.size();
+    std::vector<std::unique_ptr<SearchThread>>& search_threads = this->search_threads;
+    while (static_cast<int>(search_threads.size()) < thread_count) search_threads.push_back(std::make_unique<SearchThread>());
+    search_threads.resize(thread_count);
+    for (int i = 0; i < thread_count; i++) {
+        SearchThread& thread = *search_threads[i];
+        thread.id = i;
+        thread.board = board;
+        thread.ply = 0;
+        thread.nnue_stack[0].accumulator.computedAccumulation = 0; //* New root, refreshed by the first evaluation.
+        thread.nodes = 0;
+        thread.root_moves = moves;
+        thread.completed_depth = 0;
+        thread.best_move = moves[0]; //* Fallback if not even the first iteration completes.
+        thread.best_score = 0;
+        thread.lines.clear();
+        thread.null_move_min_ply = 0;
+        for (auto& killers : thread.history->killers) killers[0] = killers[1] = Move::NO_MOVE; //* Plies shift between searches.
+    }
+
+    std::vector<std::future<void>> helpers;
+    for (int i = 1; i < thread_count; i++) {
+        helpers.push_back(Pool.submit([this, &search_threads, i]() {
+            this->iterative_deepening(*search_threads[i], MAX_DEPTH);
+        }));
+    }
+
+    this->iterative_deepening(*search_threads[0], depth);
+
+    Bot::stop_search = true;
+    for (auto& helper : helpers) helper.wait();
+
+    const SearchThread* best = search_threads[0].get();
+    for (const auto& thread : search_threads) {
+        if (thread->completed_depth > best->completed_depth) best = thread.get();
     }
+    const bool pv_matches = !best->lines.empty() && best->lines[0].pv.size() > 1 && best->lines[0].pv[0] == best->best_move;
+    this->ponder_move = pv_matches ? best->lines[0].pv[1] : this->find_ponder_move(board, best->best_move);
+    return uci::moveToUci(best->best_move);
+}
+
+std::string score_to_uci(Value score){
+    /**
+     *  @brief Formats a search score as the UCI "cp <centipawns>" or "mate <moves>" field.
+     *
+     ** Mate scores encode the distance to mate in plies from the root (see mate_in()), which is
+     ** turned into full moves: positive if the side to move mates, negative if it gets mated.
+     *
+     *  @param score Score of a root move from the side to move's perspective.
+     *  @return The score field of an "info" line.
+    */
+    if (!is_mate_score(score)) return "cp " + std::to_string(score);
+
+    const int mate_ply = VALUE_MATE - std::abs(score);
+    return "mate " + std::to_string(score > 0 ? (mate_ply + 1) / 2 : -(mate_ply / 2));
+}
+
+void Bot::report_iteration(const SearchThread& thread, int depth){
+    /**
+     *  @brief Sends the UCI "info" lines for an iteration the main thread completed.
+     *
+     ** Sends one line per ranked root move ("multipv 1" to "multipv N"), each reporting the depth
+     ** and selective depth of the main thread, the score of that move, the node count and speed of
+     ** all search threads together, the transposition table fill and the move's principal
+     ** variation. Does nothing if no Bot::on_info receiver is set.
+     *
+     *  @param thread The main search thread, right after completing the iteration.
+     *  @param depth  The depth of the completed iteration.
+    */
+    if (!this->on_info) return;
+
+    uint64_t nodes = 0;
+    for (const auto& search_thread : this->search_threads) nodes += search_thread->nodes.load(std::memory_order_relaxed);
+    const int64_t elapsed = this->time_manager.elapsed();
 
-    // Wait for all threads to complete.
-    // std::cout << "Waiting for threads to finish...\n";
-    for (auto& thread : threads) {
-        if (thread.joinable())
-            thread.join();
+    const int hashfull = TT.hashfull();
+
+    for (size_t k = 0; k < thread.lines.size(); k++) {
+        std::string info = "info depth " + std::to_string(depth)
+                         + " seldepth " + std::to_string(std::max(thread.seldepth, depth))
+                         + " multipv " + std::to_string(k + 1)
+                         + " score " + score_to_uci(thread.lines[k].score)
+                         + " nodes " + std::to_string(nodes)
+                         + " nps " + std::to_string(nodes * 1000 / (elapsed + 1))
+                         + " hashfull " + std::to_string(hashfull)
+                         + " time " + std::to_string(elapsed)
+                         + " pv";
+        for (Move move : thread.lines[k].pv) info += " " + uci::moveToUci(move);
+        this->on_info(info);
     }
-    // std::cout << "All threads finished.\n";
-
-    std::sort(data.begin(), data.end(), [](auto &a, auto &b) {
-        return a.first > b.first;
-    });
-    // Print the results.
-    // std::cout << "Results: ";
-    // for (auto result : data) {
-    //     std::cout << result.first << " ";
-    //     std::cout << result.second << std::endl;
-    // }
-    // std::cout << std::endl;
-
-    return data[0].second;
+}
+
+Move Bot::find_ponder_move(const Board& board, Move best_move){
+    /**
+     *  @brief Finds the opponent reply the engine expects after its best move.
+     *
+     ** Used when the principal variation ends after the best move (e.g. after a transposition
+     ** table cutoff). Looks the position after the best move up in the transposition table,
+     ** which the search just filled, and accepts its move if it is legal there.
+     *
+     *  @param board     The root position.
+     *  @param best_move The move the engine is about to play.
+     *  @return The expected reply, or Move::NO_MOVE if the table does not know one.
+    */
+    Board next = board;
+    next.makeMove(best_move);
+
+    TTData tt_data;
+    if (!TT.probe(next.hash(), tt_data) || tt_data.move == Move::NO_MOVE) return Move::NO_MOVE;
+
+    Movelist moves;
+    movegen::legalmoves(moves, next);
+    return std::find(moves.begin(), moves.end(), tt_data.move) != moves.end() ? tt_data.move : Move(Move::NO_MOVE);
 }
 
 std::string Bot::middle_game_move(int depth, Board& board, char colour){
@@ -94,40 +244,40 @@ std::string Bot::middle_game_move(int depth, Board& board, char colour){
      *!          (middle_game_x_thread) and may bottleneck on deeper searches or larger positions.
     */
 
-    float best_eval;
+    Value best_eval;
     Move best_move = Move();
     Movelist moves = Movelist();
     movegen::legalmoves(moves, board);
-    float evaluation;
+    Value evaluation;
     Move move = Move();
 
     if (colour == 'w') {
-        best_eval = -99999999999.0f;
+        best_eval = -VALUE_INFINITE;
         order_moves(moves, board);
         for (int i = 0; i < moves.size(); i++) {
             move = moves[i];
             board.makeMove(move);
-            evaluation = this->minimax(depth, -9999, 9999, false, board);
+            evaluation = this->minimax(depth, -VALUE_INFINITE, VALUE_INFINITE, false, board);
             board.unmakeMove(move);
             if (evaluation > best_eval) {
                 best_eval = evaluation;
                 best_move = move;
-                if (best_eval == 9999.0f) break; //* Break if mate
+                if (best_eval == VALUE_MATE) break; //* Break if mate
             }
         }
     }
     else {
-        best_eval = 99999999999.0f;
+        best_eval = VALUE_INFINITE;
         order_moves(moves, board);
         for (int i = 0; i < moves.size(); i++){
             Move move = moves[i];
             board.makeMove(move);
-            evaluation = this->minimax(depth, -9999, 9999, true, board);
+            evaluation = this->minimax(depth, -VALUE_INFINITE, VALUE_INFINITE, true, board);
             board.unmakeMove(move);
             if (evaluation < best_eval){
                 best_eval = evaluation;
                 best_move = move;
-                if (best_eval == -9999.0f) break; //* Break if mate
+                if (best_eval == -VALUE_MATE) break; //* Break if mate
             }
         }
     }
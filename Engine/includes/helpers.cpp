@@ -9,7 +9,7 @@
  *
  *? Key helper functions include:
  *? - String manipulation: `trim()`, `lower()`, `split()`
- *? - UCI protocol parsing and option handling: `ProcessPositionCommand()`, `DisplayOptions()`, `ProcessGoCommand()`
+ *? - UCI protocol parsing and option handling: `ProcessPositionCommand()`, `DisplayOptions()`, `ProcessSetOptionCommand()`, `ProcessGoCommand()`
  *? - Response formatting and logging: `Respond()`, `TryGetLabelledValue()`, `TryGetLabelledValueInt()`
  *
  ** These functions help simplify logic in higher-level modules like the UciPlayer and Bot classes,
@@ -100,6 +100,8 @@ namespace helpers
          * @param message The message string to output and log.
         */
 
+        static std::mutex output_mutex; //* The search thread reports its move while the UCI loop keeps answering.
+        std::lock_guard<std::mutex> guard(output_mutex);
         std::cout << message << std::endl;
         Bot::LogToFile("Response sent: " + message);
     }
@@ -155,8 +157,8 @@ namespace helpers
          * Outputs engine identification and declares a set of configurable UCI options.
         */
 
-        //! These options are NOT changeable by the user.
-        //! They only exist to pass the UCI protocol requirements.
+        //! Only the options handled in ProcessSetOptionCommand() are changeable by the user.
+        //! The rest only exist to pass the UCI protocol requirements.
 
         Respond("id name Fury");
         Respond("id author Atharva\n");
@@ -165,12 +167,12 @@ namespace helpers
         Respond("option name Debug Log File type string default <empty>");
         Respond("option name NumaPolicy type string default auto");
         Respond("option name Threads type spin default 1 min 1 max 1024");
+        Respond("option name Thread Pinning type check default false");
         Respond("option name Hash type spin default 16 min 1 max 33554432");
         Respond("option name Clear Hash type button");
         Respond("option name Ponder type check default false");
         Respond("option name MultiPV type spin default 1 min 1 max 256");
         Respond("option name Skill Level type spin default 20 min 0 max 20");
-        Respond("option name Move Overhead type spin default 10 min 0 max 5000");
         Respond("option name nodestime type spin default 0 min 0 max 10000");
         Respond("option name UCI_Chess960 type check default false");
         Respond("option name UCI_LimitStrength type check default false");
@@ -215,6 +217,52 @@ namespace helpers
         }
     }
 
+    // Format: 'setoption name Hash value 64'
+    // Or: 'setoption name Clear Hash'
+    void ProcessSetOptionCommand(std::string message, UciPlayer& player) {
+        /**
+         *  @brief Parses a "setoption" command and applies the supported engine options.
+         *
+         *? Supported options:
+         *?  - "Hash"          : Resizes the shared transposition table (in MB).
+         *?  - "Clear Hash"    : Empties the shared transposition table.
+         *?  - "Move Overhead" : Milliseconds subtracted from every time budget for GUI/network lag.
+         *?  - "Threads"        : Number of workers in the shared pool (and Lazy SMP search threads).
+         *?  - "Thread Pinning" : Pins every pool worker to its own logical core.
+         *?  - "Ponder"         : Accepted; the GUI drives pondering with "go ponder" and "ponderhit".
+         *?  - "MultiPV"        : Number of best root moves searched and reported ("info ... multipv k").
+         *
+         ** Any other advertised option is accepted and ignored, but logged for debugging purposes.
+         *
+         *  @param message The UCI setoption command.
+         *  @param player A reference to the UciPlayer whose engine is being configured.
+        */
+
+        std::string name = lower(TryGetLabelledValue(message, "name", {"setoption", "name", "value"}));
+        std::string value = TryGetLabelledValue(message, "value", {"setoption", "name", "value"});
+
+        if (name == "hash") {
+            int megabytes = TryGetLabelledValueInt(message, "value", {"setoption", "name", "value"}, 16);
+            TT.resize(std::max(megabytes, 1));
+        }
+        else if (name == "clear hash") TT.clear();
+        else if (name == "move overhead") {
+            int overhead = TryGetLabelledValueInt(message, "value", {"setoption", "name", "value"}, 10);
+            player.move_overhead = std::min(std::max(overhead, 0), 5000);
+        }
+        else if (name == "threads") {
+            int threads = TryGetLabelledValueInt(message, "value", {"setoption", "name", "value"}, 1);
+            Pool.resize(std::min(std::max(threads, 1), 1024), Pool.pinned());
+        }
+        else if (name == "thread pinning") Pool.resize(Pool.size(), lower(trim(value)) == "true");
+        else if (name == "ponder") {} //* Nothing to configure, see ProcessGoCommand().
+        else if (name == "multipv") {
+            int lines = TryGetLabelledValueInt(message, "value", {"setoption", "name", "value"}, 1);
+            player.multi_pv = std::min(std::max(lines, 1), 256);
+        }
+        else Bot::LogToFile("Ignoring unsupported option: " + name + " = " + value);
+    }
+
     // Format: 'position startpos moves e2e4 e7e5'
 	// Or: 'position fen rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 moves e2e4 e7e5'
 	// Note: 'moves' section is optional
@@ -223,47 +271,72 @@ namespace helpers
          *  @brief Parses a "position" command string and sets up the board for the UciPlayer.
          *
          ** Interprets FEN strings or standard starting positions and applies subsequent move history
-         ** if provided. Useful for setting the board in preparation for a "go" command.
+         ** if provided. Useful for setting the board in preparation for a "go" command. When the
+         ** command only extends the previous one by new moves (as GUIs send it every turn), only
+         ** those moves are played (see UciPlayer::SetPosition()).
          *
          *  @param message The UCI position command.
          *  @param player A reference to the UciPlayer receiving the updated position.
         */
 
         // FEN
+        std::string fen;
         if (stringContains(lower(message), "startpos")){
-            player.SetPosition("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+            fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
         }
         else if (stringContains(lower(message), "fen")) {
-            std::string customFen = TryGetLabelledValue(message, "fen", {"position", "fen", "moves"});
-            player.SetPosition(customFen);
+            fen = TryGetLabelledValue(message, "fen", {"position", "fen", "moves"});
         }
         else{
             std::cout << "Invalid position command (expected 'startpos' or 'fen')" << std::endl;
+            return;
         }
 
         // Moves
+        std::vector<std::string> moveList;
         std::string allMoves = TryGetLabelledValue(message, "moves", {"position", "fen", "moves"});
         if (!allMoves.empty()){
-            std::vector<std::string> moveList = split(allMoves, ' ');
-            for(auto move : moveList){
-                player.MakeMove(move);
-            }
-
-            Bot::LogToFile("Make moves after setting position: " + std::to_string(moveList.size()));
+            moveList = split(allMoves, ' ');
         }
+
+        int played = player.SetPosition(fen, moveList);
+        Bot::LogToFile("Make moves after setting position: " + std::to_string(played));
     }
 
+    // Format: 'go wtime 60000 btime 60000 winc 1000 binc 1000 movestogo 40'
+    // Or: 'go movetime 1000', 'go depth 6', 'go infinite', 'go ponder wtime ...' or just 'go'
     void ProcessGoCommand(std::string message, UciPlayer& player) {
         /**
          *  @brief Handles the UCI "go" command by triggering move calculation.
          *
-         **  Responds with the best move calculated by the UciPlayer and outputs it in UCI format.
+         **  Parses the clock (wtime, btime, winc, binc, movestogo), movetime, depth, infinite and ponder
+         **  parameters into SearchLimits, then starts the search on the UciPlayer's search thread,
+         **  which streams an "info" line for every completed iteration.
+         **  The best move (with the expected reply, if known) is reported in UCI format when the search
+         **  finishes (or, for "go infinite", when "stop" is received, and for "go ponder", once
+         **  "ponderhit" or "stop" is received).
          *
          *  @param message The raw UCI "go" command text.
          *  @param player The UciPlayer instance tasked with move generation.
         */
-        
-        Respond("bestmove " + player.getBestMove());
+
+        const std::vector<std::string> labels = {"go", "wtime", "btime", "winc", "binc", "movestogo", "movetime", "depth", "nodes", "mate", "infinite", "ponder"};
+        SearchLimits limits;
+        limits.wtime = TryGetLabelledValueInt(message, "wtime", labels, -1);
+        limits.btime = TryGetLabelledValueInt(message, "btime", labels, -1);
+        limits.winc = TryGetLabelledValueInt(message, "winc", labels, 0);
+        limits.binc = TryGetLabelledValueInt(message, "binc", labels, 0);
+        limits.movestogo = TryGetLabelledValueInt(message, "movestogo", labels, 0);
+        limits.movetime = TryGetLabelledValueInt(message, "movetime", labels, -1);
+        limits.depth = TryGetLabelledValueInt(message, "depth", labels, -1);
+        std::vector<std::string> words = split(lower(message), ' ');
+        limits.infinite = std::find(words.begin(), words.end(), "infinite") != words.end();
+        limits.ponder = std::find(words.begin(), words.end(), "ponder") != words.end();
+
+        player.StartSearch(limits, [](const std::string& info) { Respond(info); },
+                           [](const std::string& best_move, const std::string& ponder_move) {
+            Respond("bestmove " + best_move + (ponder_move.empty() ? "" : " ponder " + ponder_move));
+        });
     }
 
     void clearScreen() {
@@ -301,6 +374,12 @@ namespace helpers
         Respond("   go movetime [time in ms]                                                               - Calculate the best move based on current position.");
         Respond("   go wtime [time in ms] btime [time in ms]                                               - Calculate the best move based on current position.");
         Respond("   go wtime [time in ms] btime [time in ms] winc [increment in ms] binc [increment in ms] - Calculate the best move based on current position.");
+        Respond("   go infinite                                                                            - Search until 'stop' is received.");
+        Respond("   go ponder wtime [time in ms] btime [time in ms]                                        - Ponder on the position until 'ponderhit' or 'stop'.");
+        Respond("stop              - Stop the running search and report its best move.");
+        Respond("ponderhit         - The expected move was played: turn the ponder search into a timed one.");
+        Respond("nnuebench         - Verify every supported NNUE kernel against the scalar one and time them.");
+        Respond("makebook [json] [book] - Convert a JSON opening book to the binary book format.");
         Respond("perft commands:");
         Respond("   perft [depth]    - Run a perft test at a given depth.");
         Respond("   perft -v [depth] - Run a verbose perft test at a given depth.");
@@ -343,13 +422,41 @@ namespace helpers
         return nodes;
     }
 
+    std::vector<std::pair<Move, uint64_t>> perft_divide(int depth, Board board) {
+        /**
+         *  @brief Computes the perft node count below every legal root move in parallel.
+         *
+         ** Each root move is submitted as a separate task to the shared worker pool, which works
+         ** on its own copy of the board. The results are returned in move generation order.
+         *
+         *  @param depth The search depth including the root move (at least 1).
+         *  @param board The current board position.
+         *  @return Every legal root move paired with the number of leaf nodes below it.
+        */
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+
+        std::vector<std::future<uint64_t>> tasks;
+        for (const auto& move : moves) {
+            Board child = board;
+            child.makeMove<true>(move);
+            tasks.push_back(Pool.submit([depth, child]() -> uint64_t {
+                return depth > 1 ? perft(depth - 1, child) : 1;
+            }));
+        }
+
+        std::vector<std::pair<Move, uint64_t>> results;
+        for (int i = 0; i < moves.size(); i++) results.emplace_back(moves[i], tasks[i].get());
+        return results;
+    }
+
     void perft_verbose(int depth, Board board) {
         /**
          *  @brief Performs a verbose perft test and prints node counts for each legal move.
          *
          ** Generates all legal moves from the current position and, for each move, recursively calculates
-         ** the number of leaf nodes reachable within the specified depth. Prints each move and its corresponding
-         ** node count to the console for debugging and verification purposes.
+         ** the number of leaf nodes reachable within the specified depth (in parallel, see perft_divide()).
+         ** Prints each move and its corresponding node count to the console for debugging and verification purposes.
          *
          *  @param depth The number of plies to search (depth-1 is passed to the perft function).
          *  @param board The current board state to begin the test from.
@@ -370,14 +477,9 @@ namespace helpers
             return;
         }
         uint64_t nodes = 0;
-        uint64_t result = 0;
         auto t0 = std::chrono::high_resolution_clock::now();
-        for (const auto& move : moves) {
-            std::cout << uci::moveToUci(move) << ": ";
-            board.makeMove<true>(move);
-            result = perft(depth - 1, board);
-            std::cout << result << std::endl;
-            board.unmakeMove(move);
+        for (const auto& [move, result] : perft_divide(depth, board)) {
+            std::cout << uci::moveToUci(move) << ": " << result << std::endl;
             nodes += result;
         }
         auto t1 = std::chrono::high_resolution_clock::now();
@@ -404,7 +506,8 @@ namespace helpers
         } else {
             Respond("Running perft with depth " + std::to_string(depth));
             auto t0 = std::chrono::high_resolution_clock::now();
-            auto nodes = perft(depth, player.bot.board);
+            uint64_t nodes = 0;
+            if (depth >= 1) for (const auto& [move, result] : perft_divide(depth, player.bot.board)) nodes += result;
             auto t1 = std::chrono::high_resolution_clock::now();
             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
             Respond("nodes: " + std::to_string(nodes) + " nps: " + std::to_string((nodes * 1000) / (ms + 1)) + " ms: " + std::to_string(ms));
@@ -415,20 +518,139 @@ namespace helpers
         /**
          *  @brief Processes an "eval" command to evaluate the current board position.
          *
-         **  This function interprets the eval command and outputs the evaluation score in a UCI-compliant format.
+         **  This function interprets the eval command and outputs the evaluation score in a UCI-compliant format:
+         **  centipawns from the side to move's perspective, or "#N" for a mate in N moves (negative if mated).
          *
          *  @param message The raw UCI "eval" command text.
          *  @param player The UciPlayer instance managing the current game state.
         */
 
         int depth = TryGetLabelledValueInt(message, "-d", {"eval", "-d"}, -1);
-        int eval = player.bot.stat_eval(player.bot.board, depth);
-        if (eval > -9999.0f && eval < 9999.0f) {
+        Value eval = player.bot.stat_eval(player.bot.board, depth);
+        if (!is_mate_score(eval)) {
             Respond("Eval: " + std::to_string(eval));
         } else {
-            // If eval is outside the range, we assume it's a mate score
-            int mateScore = depth - std::floor(std::abs(eval) / 9999);
+            // Mate scores count the plies to mate from the root (see mate_in())
+            int plies = VALUE_MATE - std::abs(eval);
+            int mateScore = eval > 0 ? (plies + 1) / 2 : -(plies / 2);
             Respond("Eval: #" + std::to_string(mateScore));
         }
     }
+
+    void ProcessNnueBenchCommand() {
+        /**
+         *  @brief Verifies and benchmarks every NNUE kernel variant this CPU supports.
+         *
+         ** Plays a fixed set of pseudo-random games (the seed never changes) and evaluates every
+         ** position twice per kernel: incrementally along the game (exercising the accumulator
+         ** updates) and from scratch (exercising the refresh). Both scores must match the scalar
+         ** kernel bit for bit, and the two scores of a kernel must match each other: a bug in the
+         ** shared incremental bookkeeping (e.g. the dirty piece lists) gives the same wrong score on
+         ** every kernel, so only the second check catches it. The time per kernel is reported for
+         ** both paths.
+         *
+         *! @warning The kernel in use is restored afterwards, so this can be run between games.
+        */
+        constexpr int GAMES = 64;
+        constexpr int MAX_PLIES = 100;
+        constexpr int REPEATS = 5;
+
+        std::mt19937 rng(20240611);
+        std::vector<std::vector<Move>> games;
+        for (int g = 0; g < GAMES; g++) {
+            Board board;
+            std::vector<Move> game;
+            for (int ply = 0; ply < MAX_PLIES; ply++) {
+                Movelist moves;
+                movegen::legalmoves(moves, board);
+                if (moves.empty() || board.isHalfMoveDraw()) break;
+                Move move = moves[rng() % moves.size()];
+                board.makeMove(move);
+                game.push_back(move);
+            }
+            games.push_back(game);
+        }
+
+        const std::string active = nnue_kernel_name();
+        std::vector<Value> reference;
+        std::vector<NNUEdata> stack(MAX_PLIES + 1);
+
+        for (int k = 0; k < nnue_kernel_count(); k++) {
+            bool supported = false;
+            const std::string name = nnue_kernel_info(k, &supported);
+            if (!supported) {
+                Respond(name + ": not supported by this CPU");
+                continue;
+            }
+            nnue_use_kernel(name.c_str());
+
+            std::vector<Value> scores;
+            int inconsistent = 0; //* Positions whose incremental and refreshed scores differ.
+            int64_t incremental_us = 0, refresh_us = 0;
+            for (int repeat = 0; repeat < REPEATS; repeat++) {
+                for (const auto& game : games) {
+                    Board board;
+                    stack[0].accumulator.computedAccumulation = 0;
+                    for (size_t ply = 0; ply < game.size(); ply++) {
+                        nnue_dirty_piece(board, game[ply], stack[ply + 1].dirtyPiece);
+                        stack[ply + 1].accumulator.computedAccumulation = 0;
+                        board.makeMove(game[ply]);
+
+                        auto t0 = std::chrono::steady_clock::now();
+                        Value incremental = evaluate_nnue_incremental(board, stack.data(), ply + 1);
+                        auto t1 = std::chrono::steady_clock::now();
+                        int pieces[33], squares[33];
+                        int player = nnue_piece_list(board, pieces, squares);
+                        Value refreshed = static_cast<Value>(nnue_evaluate(player, pieces, squares) / 2);
+                        auto t2 = std::chrono::steady_clock::now();
+
+                        incremental_us += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+                        refresh_us += std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+                        if (repeat == 0) {
+                            scores.push_back(incremental);
+                            scores.push_back(refreshed);
+                            inconsistent += incremental != refreshed;
+                        }
+                    }
+                }
+            }
+
+            if (reference.empty()) reference = scores;
+            int mismatches = 0;
+            for (size_t i = 0; i < scores.size(); i++) mismatches += scores[i] != reference[i];
+
+            Respond(name + ": " + std::to_string(scores.size() / 2 * REPEATS) + " positions"
+                    + " | incremental " + std::to_string(incremental_us / 1000) + " ms"
+                    + " | refresh " + std::to_string(refresh_us / 1000) + " ms"
+                    + " | mismatches vs " + nnue_kernel_info(0, &supported) + ": " + std::to_string(mismatches)
+                    + " | incremental vs refresh: " + std::to_string(inconsistent));
+        }
+        nnue_use_kernel(active.c_str());
+    }
+
+    void ProcessMakeBookCommand(std::string message) {
+        /**
+         *  @brief Processes a "makebook" command: converts a JSON opening book to the binary format.
+         *
+         ** Usage: makebook [json path] [book path]. Both default to the engine's own book files,
+         ** so a plain "makebook" rebuilds the book the engine loads. In that case the shared book
+         ** is unmapped while the file is rewritten, and mapped again afterwards.
+         *
+         *  @param message The raw "makebook" command text.
+        */
+
+        std::vector<std::string> args = split(message, ' ');
+        std::string json_path = args.size() > 1 ? args[1] : "includes\\OpeningBook\\book.json";
+        std::string book_path = args.size() > 2 ? args[2] : Resources.book_path;
+
+        const bool replaces_loaded_book = book_path == Resources.book_path;
+        if (replaces_loaded_book) Resources.opening_book.close(); //! Truncating a mapped file invalidates the mapping.
+        int entries = OpeningBook::convert(json_path, book_path);
+        if (replaces_loaded_book) Resources.reload_book();
+        if (entries < 0) {
+            Respond("Could not convert " + json_path + " to " + book_path);
+            return;
+        }
+        Respond("Wrote " + std::to_string(entries) + " book entries to " + book_path);
+    }
 } // namespace helpers
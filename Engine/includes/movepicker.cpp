@@ -0,0 +1,223 @@
+/**
+ *  @file movepicker.cpp
+ *  @brief Implements the staged move picker that feeds Bot::negamax() one move at a time.
+ *
+ ** Most nodes of the search cut off on their first or second move, so generating, scoring and
+ ** sorting every legal move up front is mostly wasted work. The picker instead produces the moves
+ ** in stages, from the most to the least promising, and only generates (and scores) a stage once
+ ** every earlier move failed to cut off.
+ *
+ *? Stages:
+ *? 1. The transposition table move, once it is verified to be legal in the position.
+ *? 2. Good captures (and capture promotions): the victim is worth at least the attacker. MVV-LVA order.
+ *? 3. The two killer moves of the ply, if they are legal quiet moves here.
+ *? 4. The countermove of the previous move (see SearchHistory), under the same condition.
+ *? 5. The remaining quiet moves (and quiet promotions), generated only now and ordered by history,
+ *?    with a bonus for checks (see CheckInfo).
+ *? 6. The bad captures, in the order they were deferred.
+ *
+ ** Within a stage the next move is found with one step of a selection sort, so the moves after
+ ** a cutoff are never sorted at all. Every move is returned exactly once.
+*/
+
+class MovePicker {
+    /**
+     *  @class MovePicker
+     *  @brief Hands out the legal moves of a search node one at a time, best candidates first.
+    */
+    public:
+        MovePicker(const SearchThread& thread, Move tt_move);
+        Move next();
+
+    private:
+        enum Stage { TT_MOVE, INIT_CAPTURES, GOOD_CAPTURES, KILLERS, COUNTERMOVE, INIT_QUIETS, QUIETS, BAD_CAPTURES, DONE };
+
+        const SearchThread& thread;
+        const Board& board;
+        Move tt_move;
+        Move killers[2];
+        Move countermove = Move::NO_MOVE;
+        int stage = TT_MOVE;
+        int killer_index = 0;
+
+        Movelist moves;                         //* The captures, later replaced by the quiet moves.
+        int scores[constants::MAX_MOVES] = {};  //* Score of moves[i].
+        int current = 0;                        //* moves[0, current) were already picked.
+        Movelist bad_captures;
+        int bad_index = 0;
+
+        bool is_legal(Move move) const;
+        void score_captures();
+        void score_quiets();
+        int pick_best();
+};
+
+MovePicker::MovePicker(const SearchThread& thread, Move tt_move)
+    : thread(thread), board(thread.board), tt_move(tt_move) {
+    /**
+     *  @brief Prepares the picker for the thread's current position. Nothing is generated yet.
+     *
+     *  @param thread  The search thread, at the ply of the node.
+     *  @param tt_move Best move stored in the transposition table for this position, if any.
+    */
+    this->killers[0] = thread.history->killers[thread.ply][0];
+    this->killers[1] = thread.history->killers[thread.ply][1];
+    if (thread.ply > 0 && thread.moved_pieces[thread.ply - 1] != Piece::NONE) {
+        const int previous_to = thread.played_moves[thread.ply - 1].to().index();
+        this->countermove = thread.history->countermoves[static_cast<int>(thread.moved_pieces[thread.ply - 1])][previous_to];
+    }
+}
+
+bool MovePicker::is_legal(Move move) const {
+    /**
+     *  @brief Checks that a move from another position (TT move, killer or countermove) is legal here.
+     *
+     ** The transposition table move can come from a hash collision and the killers and countermove
+     ** from other positions, so all of them are verified: only the legal moves of the moving piece's type are
+     ** generated, which is much cheaper than generating every legal move.
+    */
+    if (move == Move::NO_MOVE || move == Move::NULL_MOVE) return false;
+    const Piece piece = this->board.at(move.from());
+    if (piece == Piece::NONE || piece.color() != this->board.sideToMove()) return false;
+
+    Movelist legal;
+    movegen::legalmoves(legal, this->board, 1 << static_cast<int>(piece.type()));
+    return std::find(legal.begin(), legal.end(), move) != legal.end();
+}
+
+void MovePicker::score_captures() {
+    /**
+     *  @brief Scores the captures by MVV-LVA; captures that risk material get a negative score.
+     *
+     ** A capture is "good" if the victim is worth at least the attacker, if it promotes, or if the
+     ** king captures (which is only legal on an undefended square). Without a static exchange
+     ** evaluation the other captures may still win material, so they are only deferred, not pruned.
+    */
+    static constexpr int VALUES[7] = {1, 3, 3, 5, 9, 0, 0};
+
+    for (int i = 0; i < this->moves.size(); i++) {
+        const Move move = this->moves[i];
+        //* En passant lands on an empty square but always captures a pawn.
+        const PieceType victim = move.typeOf() == Move::ENPASSANT ? PieceType(PieceType::PAWN) : this->board.at<PieceType>(move.to());
+        const PieceType attacker = this->board.at<PieceType>(move.from());
+
+        int score = (static_cast<int>(victim) + 1) * 16 - static_cast<int>(attacker);
+        if (move.typeOf() == Move::PROMOTION) score += (static_cast<int>(move.promotionType()) + 1) * 16;
+
+        const bool good = move.typeOf() == Move::PROMOTION || attacker == PieceType::KING
+                       || VALUES[static_cast<int>(victim)] >= VALUES[static_cast<int>(attacker)];
+        this->scores[i] = good ? score : score - 1000;
+    }
+}
+
+void MovePicker::score_quiets() {
+    /**
+     *  @brief Scores the quiet moves by their history (see SearchThread::quiet_history()).
+     *
+     ** Queen promotions go first and under-promotions last; checks and castling get a bonus.
+    */
+    const CheckInfo check_info(this->board);
+    for (int i = 0; i < this->moves.size(); i++) {
+        const Move move = this->moves[i];
+        int score = this->thread.quiet_history(this->board.at(move.from()), move);
+
+        if (move.typeOf() == Move::PROMOTION) {
+            score = move.promotionType() == PieceType::QUEEN ? 1000000 : -1000000;
+        } else if (move.typeOf() == Move::CASTLING) {
+            score += 1000;
+        }
+        if (check_info.gives_check(this->board, move)) score += 20000;
+        this->scores[i] = score;
+    }
+}
+
+int MovePicker::pick_best() {
+    /**
+     *  @brief One selection sort step: swaps the best remaining move to the front of the rest.
+     *
+     *  @return The index of the picked move.
+    */
+    int best = this->current;
+    for (int i = this->current + 1; i < this->moves.size(); i++) {
+        if (this->scores[i] > this->scores[best]) best = i;
+    }
+    std::swap(this->moves[best], this->moves[this->current]);
+    std::swap(this->scores[best], this->scores[this->current]);
+    return this->current++;
+}
+
+Move MovePicker::next() {
+    /**
+     *  @brief Returns the next move to search.
+     *
+     *  @return A legal move, or Move::NO_MOVE once every legal move has been returned.
+    */
+    switch (this->stage) {
+        case TT_MOVE:
+            this->stage = INIT_CAPTURES;
+            if (this->is_legal(this->tt_move)) return this->tt_move;
+            [[fallthrough]];
+
+        case INIT_CAPTURES:
+            movegen::legalmoves<movegen::MoveGenType::CAPTURE>(this->moves, this->board);
+            this->score_captures();
+            this->current = 0;
+            this->stage = GOOD_CAPTURES;
+            [[fallthrough]];
+
+        case GOOD_CAPTURES:
+            while (this->current < this->moves.size()) {
+                const int index = this->pick_best();
+                const Move move = this->moves[index];
+                if (move == this->tt_move) continue;
+                if (this->scores[index] < 0) {
+                    this->bad_captures.add(move);
+                    continue;
+                }
+                return move;
+            }
+            this->stage = KILLERS;
+            [[fallthrough]];
+
+        case KILLERS:
+            while (this->killer_index < 2) {
+                const Move killer = this->killers[this->killer_index++];
+                //! A killer can be a capture in this position, which the capture stages already returned.
+                if (killer != this->tt_move && !this->board.isCapture(killer) && this->is_legal(killer)) return killer;
+            }
+            this->stage = COUNTERMOVE;
+            [[fallthrough]];
+
+        case COUNTERMOVE:
+            this->stage = INIT_QUIETS;
+            if (this->countermove != this->tt_move && this->countermove != this->killers[0] && this->countermove != this->killers[1]
+                && !this->board.isCapture(this->countermove) && this->is_legal(this->countermove)) {
+                return this->countermove;
+            }
+            [[fallthrough]];
+
+        case INIT_QUIETS:
+            movegen::legalmoves<movegen::MoveGenType::QUIET>(this->moves, this->board);
+            this->score_quiets();
+            this->current = 0;
+            this->stage = QUIETS;
+            [[fallthrough]];
+
+        case QUIETS:
+            while (this->current < this->moves.size()) {
+                const Move move = this->moves[this->pick_best()];
+                if (move == this->tt_move || move == this->killers[0] || move == this->killers[1] || move == this->countermove) continue;
+                return move;
+            }
+            this->stage = BAD_CAPTURES;
+            [[fallthrough]];
+
+        case BAD_CAPTURES:
+            if (this->bad_index < this->bad_captures.size()) return this->bad_captures[this->bad_index++];
+            this->stage = DONE;
+            [[fallthrough]];
+
+        default:
+            return Move::NO_MOVE;
+    }
+}
@@ -8,8 +8,11 @@
  *
  *? Features:
  *? - Lightweight wrappers over lower-level NNUE probing functions
- *? - Score normalization from centipawns to pawn units
+ *? - Score normalization from network centipawns to the engine's Value scale
  *? - FEN-based direct evaluation support for easy debugging or position analysis
+ *? - Incremental evaluation over a per-thread, ply-indexed accumulator stack (see `evaluate_nnue_incremental`)
+ *? - Direct Board to piece/square list conversion from the bitboards, without a FEN round-trip
+ *? - The SIMD kernels are chosen at runtime for the host CPU by `nnue_init` (see NNUE/nnue_kernels.h)
  *
  *  @note The scores returned by `evaluate_fen_nnue` are halved for scaling compatibility with classical evaluation.
 */
@@ -18,7 +21,7 @@
 #include "NNUE/misc.cpp"
 
 // init NNUE
-void init_nnue(char *filename)
+void init_nnue(const char *filename)
 {
     // call NNUE probe lib function
     nnue_init(filename);
@@ -32,11 +35,154 @@ int evaluate_nnue(int player, int *pieces, int *squares)
 }
 
 // get NNUE score from FEN input
-float evaluate_fen_nnue(std::string fen)
+Value evaluate_fen_nnue(std::string fen)
 {
     // call NNUE probe lib function
-    // The NNUE score is in centipawns, so we need to divide by 100 to get actual score
-    // The NNUE also tends to make the score around twice as large as it should be, so we divide by 2 again
-    // to get a more accurate score.
-    return nnue_evaluate_fen((char *)fen.c_str())/200.0f;
+    // The NNUE score is in centipawns, but the network tends to make the score around twice as
+    // large as it should be, so we divide by 2 to get a more accurate score.
+    return static_cast<Value>(nnue_evaluate_fen((char *)fen.c_str()) / 2);
+}
+
+// Longest run of not yet computed plies that is caught up with incremental updates before
+// falling back to a full refresh.
+constexpr int NNUE_MAX_UPDATE_CHAIN = 8;
+
+// chess::Piece (WHITEPAWN = 0 ... BLACKKING = 11) to the NNUE `pieces` enum
+constexpr int NNUE_PIECE[12] = {wpawn, wknight, wbishop, wrook, wqueen, wking,
+                                bpawn, bknight, bbishop, brook, bqueen, bking};
+
+int nnue_piece_list(const Board& board, int* pieces, int* squares)
+{
+    /**
+     *  @brief Builds the NNUE piece/square arrays straight from the board's bitboards.
+     *
+     ** Replaces the getFen() + decode_fen() round-trip: no strings are built or parsed and
+     ** nothing is allocated. The layout is the one expected by nnue_evaluate():
+     *? - pieces[0] / squares[0]: white king
+     *? - pieces[1] / squares[1]: black king
+     *? - the remaining pieces in any order, terminated by pieces[n] = 0
+     *
+     *  @param board   The position to convert.
+     *  @param pieces  Receives the NNUE piece codes (room for 33 entries).
+     *  @param squares Receives the matching squares (A1 = 0 ... H8 = 63).
+     *  @return The side to move (white = 0, black = 1).
+    */
+    pieces[0] = wking;
+    squares[0] = board.kingSq(Color::WHITE).index();
+    pieces[1] = bking;
+    squares[1] = board.kingSq(Color::BLACK).index();
+
+    int index = 2;
+    for (int color = 0; color < 2; color++) {
+        for (int type = 0; type < 5; type++) { //* PAWN ... QUEEN, kings are already placed
+            const int pc = NNUE_PIECE[color * 6 + type];
+            Bitboard bb = board.pieces(PieceType(static_cast<PieceType::underlying>(type)), Color(color));
+            while (bb) {
+                pieces[index] = pc;
+                squares[index] = bb.pop();
+                index++;
+            }
+        }
+    }
+    pieces[index] = 0;
+    squares[index] = 0;
+
+    return board.sideToMove() == Color::WHITE ? white : black;
+}
+
+void nnue_dirty_piece(const Board& board, Move move, DirtyPiece& dp)
+{
+    /**
+     *  @brief Describes which pieces a move adds and removes, for NNUE incremental updates.
+     *
+     ** Must be called before the move is made. pc[0] is always the moving piece, so the NNUE
+     ** update can detect king moves (which require a refresh of that side's accumulator).
+     *
+     *  @param board The position before the move.
+     *  @param move  The move about to be made.
+     *  @param dp    Receives the changed pieces (square 64 means "not on the board").
+    */
+    const Square from = move.from();
+    const Square to = move.to();
+    const int moving = NNUE_PIECE[static_cast<int>(board.at(from))];
+
+    dp.dirtyNum = 1;
+    dp.pc[0] = moving;
+    dp.from[0] = from.index();
+    dp.to[0] = to.index();
+
+    if (move.typeOf() == Move::CASTLING) {
+        //* chess.hpp encodes castling as "king takes own rook".
+        const bool king_side = to > from;
+        const Color us = board.sideToMove();
+        dp.to[0] = Square::castling_king_square(king_side, us).index();
+        dp.pc[1] = NNUE_PIECE[static_cast<int>(board.at(to))];
+        dp.from[1] = to.index();
+        dp.to[1] = Square::castling_rook_square(king_side, us).index();
+        dp.dirtyNum = 2;
+        return;
+    }
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        const Square captured = to.ep_square();
+        dp.pc[1] = NNUE_PIECE[static_cast<int>(board.at(captured))];
+        dp.from[1] = captured.index();
+        dp.to[1] = 64;
+        dp.dirtyNum = 2;
+        return;
+    }
+
+    if (board.at(to) != Piece::NONE) {
+        dp.pc[dp.dirtyNum] = NNUE_PIECE[static_cast<int>(board.at(to))];
+        dp.from[dp.dirtyNum] = to.index();
+        dp.to[dp.dirtyNum] = 64;
+        dp.dirtyNum++;
+    }
+
+    if (move.typeOf() == Move::PROMOTION) {
+        dp.to[0] = 64; //* The pawn leaves the board...
+        dp.pc[dp.dirtyNum] = NNUE_PIECE[static_cast<int>(Piece(move.promotionType(), board.sideToMove()))];
+        dp.from[dp.dirtyNum] = 64;
+        dp.to[dp.dirtyNum] = to.index(); //* ...and the promoted piece appears.
+        dp.dirtyNum++;
+    }
+}
+
+Value evaluate_nnue_incremental(const Board& board, NNUEdata* stack, int ply)
+{
+    /**
+     *  @brief Evaluates the position at the top of a thread's accumulator stack.
+     *
+     ** stack[i] holds the accumulator of the position i plies from the root and the pieces
+     ** changed by the move leading to it. Accumulators are only computed when a position is
+     ** evaluated, so before evaluating, the nearest computed ancestor (at most
+     ** NNUE_MAX_UPDATE_CHAIN plies back) is carried forward one move at a time. A king move on
+     ** the way, or no computed ancestor at all, makes the evaluation refresh the accumulator.
+     *
+     *  @param board The current position (the one reached at `ply`).
+     *  @param stack The search thread's accumulator stack.
+     *  @param ply   Index of the current position in the stack.
+     *  @return The NNUE score from the side to move's perspective, in the same units as evaluate_fen_nnue().
+    */
+    int pieces[33], squares[33];
+    const int player = nnue_piece_list(board, pieces, squares);
+
+    if (!stack[ply].accumulator.computedAccumulation) {
+        //* Walk back to the nearest computed accumulator. The intermediate updates only need the
+        //* king squares, which are those of the current position unless a king moved in between.
+        int base = ply;
+        while (base > 0 && ply - base < NNUE_MAX_UPDATE_CHAIN
+               && !stack[base].accumulator.computedAccumulation
+               && !IS_KING(stack[base].dirtyPiece.pc[0])) base--;
+
+        if (base < ply - 1 && stack[base].accumulator.computedAccumulation) {
+            for (int i = base + 1; i < ply; i++) {
+                Position pos = {player, pieces, squares, {&stack[i], &stack[i - 1], nullptr}};
+                nnue_update_accumulator(&pos);
+            }
+        }
+    }
+
+    NNUEdata* nnue[3] = {&stack[ply], ply > 0 ? &stack[ply - 1] : nullptr, nullptr};
+    return static_cast<Value>(nnue_evaluate_incremental(player, pieces, squares, nnue) / 2);
 }
@@ -0,0 +1,41 @@
+/**
+ *  @file resources.cpp
+ *  @brief Loads the engine data shared by every Bot for the lifetime of the process.
+ *
+ ** The UCI front end creates a new Bot for every "ucinewgame" and "position" command, so the
+ ** Bot must not own anything expensive. The NNUE network, the opening book mapping and the
+ ** evaluation tables are loaded or built once here, and each Bot only keeps a pointer to them.
+ *
+ *! @warning The resources are read concurrently by every search thread; they must only be
+ *!          modified while no search is running (e.g. by the "makebook" command).
+*/
+
+void EngineResources::load(const std::string& nnue_path, const std::string& book_path) {
+    /**
+     *  @brief Loads the NNUE network and maps the opening book. Called once at startup.
+     *
+     ** Both are optional: without a network the handcrafted evaluation is used, and without a
+     ** book every Bot starts in the midgame stage.
+     *
+     *  @param nnue_path  Path of the NNUE network file.
+     *  @param book_path  Path of the binary opening book.
+    */
+    init_nnue(nnue_path.c_str());
+    this->book_path = book_path;
+    this->reload_book();
+}
+
+bool EngineResources::reload_book() {
+    /**
+     *  @brief (Re)maps the opening book from EngineResources::book_path.
+     *
+     *  @return True if the book was opened; otherwise false and the book is empty.
+    */
+    if (!this->opening_book.open(this->book_path)) {
+        Bot::LogToFile("Error: Could not open opening book " + this->book_path);
+        return false;
+    }
+    return true;
+}
+
+EngineResources Resources; //* Shared by every Bot and search thread for the lifetime of the process.
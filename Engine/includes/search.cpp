@@ -7,55 +7,357 @@
  ** function for evaluating a single candidate move.
  *
  ** Evaluation functions may delegate to NNUE-based or heuristic scoring depending on phase and configuration.
+** Negamax leaves are resolved with a capture-only quiescence search before being evaluated.
+** Negamax results are cached in the shared transposition table (see transposition.cpp).
+** Negamax nodes get their moves one at a time from a staged MovePicker (see movepicker.cpp).
+** Late quiet moves are searched to a reduced depth first (see ReductionTable).
 */
 
-#include "nnue_eval.cpp"
+#include "transposition.cpp"
+#include "movepicker.cpp"
 
-float Bot::negamax(int depth, float alpha, float beta, Board& board){
+struct ReductionTable {
+    /**
+     *  @struct ReductionTable
+     *  @brief Base late move reduction for every depth and move number, see Bot::negamax().
+     *
+     ** The reduction grows with the logarithm of both, so deep searches and very late moves are
+     ** reduced most. Computed once at startup.
+    */
+    int8_t reductions[MAX_DEPTH + 1][constants::MAX_MOVES] = {};
+
+    ReductionTable() {
+        for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+            for (int move = 1; move < constants::MAX_MOVES; move++) {
+                this->reductions[depth][move] = static_cast<int8_t>(0.75 + std::log(depth) * std::log(move) / 2.25);
+            }
+        }
+    }
+
+    int at(int depth, int move_count) const {
+        return this->reductions[std::min(depth, MAX_DEPTH)][std::min(move_count, constants::MAX_MOVES - 1)];
+    }
+};
+
+const ReductionTable LMR_REDUCTIONS;
+
+Value Bot::negamax(int depth, Value alpha, Value beta, SearchThread& thread){
     /**
      *  @brief Negamax search with alpha-beta pruning.
      *
      **  Recursively explores the game tree using negamax, a variant of minimax where the evaluation
      **  is always from the current player's perspective (negated recursively).
      **  Alpha-beta pruning is applied to improve performance by eliminating branches that won't influence the result.
+     **  Every node probes the shared transposition table first: in a zero-window node a deep enough entry
+     **  can return immediately, and otherwise its best move is searched first. The result is stored back before returning.
+     **  Moves come from a MovePicker, so the later stages are never generated after an early cutoff.
+     **  Principal variation search: only the first move gets the full window. The others are expected
+     **  to be worse and are searched with a zero window around alpha, which is much cheaper, and only
+     **  re-searched with the full window if they unexpectedly beat alpha.
+     *
+     *? Null move pruning: in a zero-window node whose static evaluation already beats beta, the
+     *? side to move passes and the opponent gets a reduced search (R = 3 + depth / 4, more when the
+     *? evaluation is far above beta). If even that fails high, the node is cut off. It is skipped:
+     *? - in check, after another null move, and near mate scores;
+     *? - without knights, bishops, rooks or queens (pawn and king-and-pawn endings), where passing
+     *?   is often the best move (zugzwang) and the assumption behind the pruning breaks down;
+     *? - when the transposition table already says the node scores below beta.
+     *? At high depth a cutoff is only trusted after a verification search of the node itself, with
+     *? null moves disabled, which catches the remaining zugzwang positions.
+     *
+     *? Late move reductions: a late quiet move (from the third one on, at depth 3 or more, not in
+     *? check) is unlikely to beat alpha after the ordering put it there, so its zero-window search
+     *? is reduced by a depth and move number dependent amount (see ReductionTable). It is reduced
+     *? less in PV nodes, when it gives check and when it has a good history, and more when the
+     *? side's static evaluation is not improving. A reduced move that beats alpha is re-searched
+     *? at full depth before the full window re-search.
+     **  A quiet move that causes a beta cutoff updates the thread's killer, countermove and history
+     **  tables (see Bot::update_quiet_stats()), which the MovePicker of later nodes uses to order their quiet moves.
      *
      *  @param depth Remaining depth to search.
      *  @param alpha Best score that the maximizing player is guaranteed to achieve.
      *  @param beta Best score that the minimizing player is guaranteed to allow.
-     *  @param board The current board position.
-     *  @return A float evaluation score from the current player's perspective.
+     *  @param thread The search thread whose board holds the current position.
+     *  @return The score from the current player's perspective (see Value).
      *
-     *  @note Returns large negative values for checkmate, and 0 for non-checkmate game results.
-     *  @see evaluate_fen_nnue
+     *  @note Returns mated_in(ply) for checkmate, and 0 for non-checkmate game results.
+     *        Draws by rule are cheap counter and bitboard tests; checkmate and stalemate are only
+     *        known once the move loop found no legal move, so legal moves are generated once per node.
+     *  @see Bot::quiescence
     */
-    std::pair<GameResultReason, GameResult> isGameOver = board.isGameOver();
-    if (isGameOver.first == GameResultReason::CHECKMATE){
-        return -9999.0f * depth; //* Prefer faster checkmates
-    } else if (!(isGameOver.first == GameResultReason::NONE)){
-        return 0.0f;
+    thread.pv_length[thread.ply] = thread.ply;
+    if (this->should_stop(thread)) return VALUE_DRAW; //* Aborted, the caller discards this result.
+    thread.count_node();
+
+    Board& board = thread.board;
+    const bool in_check = board.inCheck();
+
+    if (board.isHalfMoveDraw()) {
+        //! Checkmate takes precedence over the 50 move rule.
+        return in_check && !this->hasAnyLegalMove(board) ? mated_in(thread.ply) : Value(VALUE_DRAW);
+    }
+    if (board.isInsufficientMaterial() || board.isRepetition()) return VALUE_DRAW;
+    if (depth == 0) {
+        //* The quiescence search finds checkmates itself, but would stand pat in a stalemate.
+        if (!in_check && !this->hasAnyLegalMove(board)) return VALUE_DRAW;
+        return this->quiescence(alpha, beta, thread);
     }
-    else if (depth == 0) return evaluate_fen_nnue(board.getFen());
 
-    Move move = Move();
-    Movelist moves = Movelist();
-    movegen::legalmoves(moves, board);
-    float best_eval = -999999999999.9f;
-    float evaluation = 0;
-    order_moves(moves, board);
-    for (auto move : moves) {
-        // move = moves[i];
-        board.makeMove(move);
-        evaluation = -this->negamax(depth - 1, -beta, -alpha, board);
-        board.unmakeMove(move);
-        best_eval = std::max(best_eval, evaluation);
+    static constexpr int NULL_MOVE_DEPTH = 3;
+    static constexpr int NULL_MOVE_VERIFICATION_DEPTH = 12;
+    static constexpr int LMR_DEPTH = 3;
+    static constexpr int LMR_MIN_MOVE = 3;
+
+    const uint64_t key = board.hash();
+    const Value alpha_orig = alpha;
+    const bool pv_node = beta - alpha > 1;
+    Move tt_move = Move::NO_MOVE;
+    TTData tt_data;
+    const bool tt_hit = TT.probe(key, tt_data);
+    const Value tt_score = tt_hit ? value_from_tt(tt_data.score, thread.ply) : Value(VALUE_DRAW);
+    if (tt_hit) {
+        tt_move = tt_data.move;
+        //* Never in PV nodes: the cutoff would leave the principal variation of the node empty.
+        if (!pv_node && tt_data.depth >= depth) {
+            if (tt_data.bound == BOUND_EXACT) return tt_score;
+            if (tt_data.bound == BOUND_LOWER && tt_score >= beta) return tt_score;
+            if (tt_data.bound == BOUND_UPPER && tt_score <= alpha) return tt_score;
+        }
+    }
+
+    //* The static evaluation of every ply is kept, so a node can tell whether its side's position
+    //* improved since its previous move (two plies up). Unknown while in check.
+    const Value static_eval = in_check ? Value(VALUE_NONE) : this->evaluate(thread);
+    thread.static_evals[thread.ply] = static_eval;
+    const bool improving = !in_check && (thread.ply < 2 || thread.static_evals[thread.ply - 2] == VALUE_NONE
+                                         || static_eval > thread.static_evals[thread.ply - 2]);
+
+    const Color us = board.sideToMove();
+    const bool has_pieces = static_cast<bool>(board.pieces(PieceType::KNIGHT, us) | board.pieces(PieceType::BISHOP, us)
+                                            | board.pieces(PieceType::ROOK, us) | board.pieces(PieceType::QUEEN, us));
+    if (!pv_node && !in_check && depth >= NULL_MOVE_DEPTH && has_pieces && !is_mate_score(beta)
+        && thread.ply > 0 && thread.ply >= thread.null_move_min_ply
+        && thread.played_moves[thread.ply - 1] != Move::NULL_MOVE
+        && !(tt_hit && tt_data.bound == BOUND_UPPER && tt_score < beta)) {
+        if (static_eval >= beta) {
+            const int reduction = 3 + depth / 4 + std::min((static_eval - beta) / 200, 3);
+            this->make_null_move(thread);
+            Value null_score = -this->negamax(std::max(depth - 1 - reduction, 0), -beta, -beta + 1, thread);
+            this->unmake_null_move(thread);
+            if (Bot::stop_search) return VALUE_DRAW;
+
+            if (null_score >= beta) {
+                if (null_score >= VALUE_MATE_IN_MAX_PLY) null_score = beta; //! A mate found after passing is not a real mate.
+                bool verified = depth < NULL_MOVE_VERIFICATION_DEPTH;
+                if (!verified) {
+                    const int previous_min_ply = thread.null_move_min_ply; //* Set by an enclosing verification, if any.
+                    thread.null_move_min_ply = std::max(previous_min_ply, thread.ply + 3 * (depth - reduction) / 4);
+                    verified = this->negamax(std::max(depth - reduction, 1), beta - 1, beta, thread) >= beta;
+                    thread.null_move_min_ply = previous_min_ply;
+                    if (Bot::stop_search) return VALUE_DRAW;
+                }
+                if (verified) {
+                    TT.store(key, depth, BOUND_LOWER, value_to_tt(null_score, thread.ply), Move::NO_MOVE);
+                    return null_score;
+                }
+            }
+        }
+    }
+
+    Move best_move = Move::NO_MOVE;
+    Value best_eval = -VALUE_INFINITE;
+    Value evaluation = VALUE_DRAW;
+    Movelist quiets_tried;
+    MovePicker picker(thread, tt_move);
+    Move move;
+    int move_count = 0;
+    while ((move = picker.next()) != Move::NO_MOVE) {
+        const bool quiet = !board.isCapture(move) && move.typeOf() != Move::PROMOTION;
+        move_count++;
+        const bool late_quiet = quiet && !in_check && depth >= LMR_DEPTH && move_count >= LMR_MIN_MOVE;
+        const int history = late_quiet ? thread.quiet_history(board.at(move.from()), move) : 0;
+        this->make_move(thread, move);
+        if (move_count == 1) {
+            evaluation = -this->negamax(depth - 1, -beta, -alpha, thread);
+        } else {
+            int reduction = 0;
+            if (late_quiet) {
+                reduction = LMR_REDUCTIONS.at(depth, move_count);
+                reduction -= pv_node;
+                reduction += !improving;
+                reduction -= board.inCheck();    //* The move gives check.
+                reduction -= history / 8192;
+                reduction = std::max(0, std::min(reduction, depth - 2)); //* Never drops into the quiescence search.
+            }
+            evaluation = -this->negamax(depth - 1 - reduction, -alpha - 1, -alpha, thread);
+            if (reduction > 0 && evaluation > alpha) evaluation = -this->negamax(depth - 1, -alpha - 1, -alpha, thread);
+            if (evaluation > alpha && evaluation < beta) evaluation = -this->negamax(depth - 1, -beta, -alpha, thread);
+        }
+        this->unmake_move(thread, move);
+        if (evaluation > best_eval) {
+            best_eval = evaluation;
+            best_move = move;
+        }
+        if (evaluation > alpha) thread.update_pv(move);
+        alpha = std::max(alpha, evaluation);
+        if (beta <= alpha) {  // Beta cutoff
+            if (quiet && !Bot::stop_search) this->update_quiet_stats(thread, move, depth, quiets_tried);
+            break;
+        }
+        if (quiet) quiets_tried.add(move);
+    }
+    if (best_move == Move::NO_MOVE) {
+        return in_check ? mated_in(thread.ply) : Value(VALUE_DRAW); //* Checkmate (faster ones score higher) or stalemate.
+    }
+    if (Bot::stop_search) return VALUE_DRAW; //* Never store scores of an aborted search.
+
+    Bound bound = best_eval >= beta ? BOUND_LOWER : best_eval <= alpha_orig ? BOUND_UPPER : BOUND_EXACT;
+    TT.store(key, depth, bound, value_to_tt(best_eval, thread.ply), best_move);
+    return best_eval;
+}
+
+
+Value Bot::quiescence(Value alpha, Value beta, SearchThread& thread, int qs_ply){
+    /**
+     *  @brief Capture-only search used at the leaves of Bot::negamax().
+     *
+     ** Evaluating a position in the middle of an exchange gives wildly wrong scores, so instead
+     ** of returning the static evaluation at depth 0 the search continues with captures (and
+     ** capture promotions) until the position is quiet.
+     *
+     *? - Stand pat: the side to move may decline every capture, so the static evaluation is a
+     *?   lower bound and can cause an immediate cutoff.
+     *? - Delta pruning: captures that cannot raise the score to alpha even when winning the
+     *?   victim plus a safety margin are skipped.
+     *? - Captures are tried in MVV-LVA order (see Bot::order_captures()).
+     *? - In check all evasions are searched instead, since standing pat is not an option. Past
+     *?   MAX_QS_PLY plies the evasions are scored by their static evaluation instead of searched.
+     *
+     *  @param alpha Best score that the side to move is guaranteed to achieve.
+     *  @param beta Best score that the opponent is guaranteed to allow.
+     *  @param thread The search thread whose board holds the current position.
+     *  @param qs_ply Number of plies already searched inside the quiescence search.
+     *  @return The score from the current player's perspective (see Value).
+    */
+    static constexpr int PIECE_VALUES[7] = {50, 150, 150, 250, 450, 0, 0}; //* On the NNUE scale (network centipawns / 2).
+    static constexpr int DELTA_MARGIN = 100;
+    static constexpr int MAX_QS_PLY = 16;
+
+    if (this->should_stop(thread)) return VALUE_DRAW; //* Aborted, the caller discards this result.
+    thread.count_node();
+
+    Board& board = thread.board;
+    const bool in_check = board.inCheck();
+
+    //! The ply cap guards against endless check/evasion sequences.
+    const bool at_ply_cap = qs_ply >= MAX_QS_PLY;
+    Movelist moves;
+    Value stand_pat = VALUE_NONE;
+    Value best_eval;
+    if (in_check) {
+        movegen::legalmoves(moves, board);
+        if (moves.empty()) return mated_in(thread.ply); //* Checkmated
+        best_eval = -VALUE_INFINITE;
+    } else {
+        stand_pat = this->evaluate(thread);
+        if (at_ply_cap || stand_pat >= beta) return stand_pat;
+        alpha = std::max(alpha, stand_pat);
+        best_eval = stand_pat;
+        movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, board);
+    }
+    this->order_captures(moves, board);
+
+    for (const auto& move : moves) {
+        if (!in_check && move.typeOf() != Move::PROMOTION) {
+            PieceType victim = move.typeOf() == Move::ENPASSANT ? PieceType(PieceType::PAWN) : board.at<PieceType>(move.to());
+            if (stand_pat + PIECE_VALUES[static_cast<int>(victim)] + DELTA_MARGIN < alpha) continue;
+        }
+
+        this->make_move(thread, move);
+        //* At the ply cap the evasions are only evaluated statically, which ends the sequence.
+        const Value evaluation = at_ply_cap ? Value(-this->evaluate(thread)) : Value(-this->quiescence(-beta, -alpha, thread, qs_ply + 1));
+        this->unmake_move(thread, move);
+
+        if (evaluation > best_eval) best_eval = evaluation;
         alpha = std::max(alpha, evaluation);
         if (beta <= alpha) break;  // Beta cutoff
     }
     return best_eval;
 }
 
+void Bot::make_move(SearchThread& thread, Move move){
+    /**
+     *  @brief Plays a move on a search thread's board and pushes its NNUE accumulator stack.
+     *
+     ** The new ply records which pieces the move changed and is marked as not computed; its
+     ** accumulator is only updated from its parent once the position is actually evaluated.
+     ** The move and the piece making it are recorded for the move ordering of the child nodes.
+     *
+     *  @param thread The search thread.
+     *  @param move A legal move in the thread's current position.
+    */
+    NNUEdata& next = thread.nnue_stack[thread.ply + 1];
+    nnue_dirty_piece(thread.board, move, next.dirtyPiece);
+    next.accumulator.computedAccumulation = 0;
+    thread.played_moves[thread.ply] = move;
+    thread.moved_pieces[thread.ply] = thread.board.at(move.from());
+    thread.ply++;
+    thread.seldepth = std::max(thread.seldepth, thread.ply);
+    thread.board.makeMove(move);
+}
 
-float Bot::minimax(int depth, float alpha, float beta, bool maximizing_player, Board& board){
+void Bot::unmake_move(SearchThread& thread, Move move){
+    /**
+     *  @brief Takes back a move played with Bot::make_move() and pops the accumulator stack.
+    */
+    thread.board.unmakeMove(move);
+    thread.ply--;
+}
+
+void Bot::make_null_move(SearchThread& thread){
+    /**
+     *  @brief Passes the turn on a search thread's board (for null move pruning).
+     *
+     ** No piece changes, so the new ply gets an empty dirty piece list: evaluating it carries the
+     ** parent's accumulator over unchanged instead of refreshing it.
+    */
+    NNUEdata& next = thread.nnue_stack[thread.ply + 1];
+    next.dirtyPiece.dirtyNum = 0;
+    next.dirtyPiece.pc[0] = blank; //* Not a king move, which would force a refresh.
+    next.accumulator.computedAccumulation = 0;
+    thread.played_moves[thread.ply] = Move::NULL_MOVE;
+    thread.moved_pieces[thread.ply] = Piece::NONE;
+    thread.ply++;
+    thread.board.makeNullMove();
+}
+
+void Bot::unmake_null_move(SearchThread& thread){
+    /**
+     *  @brief Takes back a null move played with Bot::make_null_move().
+    */
+    thread.board.unmakeNullMove();
+    thread.ply--;
+}
+
+bool Bot::should_stop(SearchThread& thread){
+    /**
+     *  @brief Checks whether the running search has to be aborted.
+     *
+     ** Polls the hard time limit every 1024 nodes of the given thread and raises Bot::stop_search
+     ** once it is exceeded, so every other search thread stops at its next node as well. While
+     ** pondering the clock is not running yet, so only an explicit stop ends the search.
+     *
+     *  @param thread The search thread asking.
+     *  @return True if the search should return immediately.
+    */
+    if (Bot::stop_search.load(std::memory_order_relaxed)) return true;
+    if ((thread.nodes.load(std::memory_order_relaxed) & 1023) == 0 && !Bot::pondering.load(std::memory_order_relaxed)
+        && this->time_manager.hard_limit_reached()) Bot::stop_search = true;
+    return Bot::stop_search.load(std::memory_order_relaxed);
+}
+
+
+Value Bot::minimax(int depth, Value alpha, Value beta, bool maximizing_player, Board& board){
     /**
      *  @brief Minimax search with alpha-beta pruning.
      *
@@ -67,27 +369,27 @@ float Bot::minimax(int depth, float alpha, float beta, bool maximizing_player, B
      *  @param beta Best score that the minimizing player is guaranteed to allow.
      *  @param maximizing_player Flag indicating whether current player is maximizing or minimizing.
      *  @param board The current board position.
-     *  @return A float evaluation score representing the best possible outcome.
+     *  @return The best possible outcome in centipawns from white's perspective.
      *
-     *  @note Returns large positive/negative values for checkmate, and 0 for non-checkmate game results.
+     *  @note Returns +/-VALUE_MATE for checkmate, and 0 for non-checkmate game results.
      *  @note Uses move ordering and alpha-beta pruning to improve search efficiency.
     */
 
-    std::pair<GameResultReason, GameResult> isGameOver = board.isGameOver();
-    if (isGameOver.first == GameResultReason::CHECKMATE){
-        if (board.sideToMove() == Color::WHITE) return -9999.0f;
-        else return 9999.0f;
-    } else if (!(isGameOver.first == GameResultReason::NONE)){
-        return 0.0f;
+    const Value mated = board.sideToMove() == Color::WHITE ? -VALUE_MATE : VALUE_MATE;
+    if (board.isHalfMoveDraw()) return board.inCheck() && !this->hasAnyLegalMove(board) ? mated : Value(VALUE_DRAW);
+    if (board.isInsufficientMaterial() || board.isRepetition()) return VALUE_DRAW;
+    if (depth == 0) {
+        if (!this->hasAnyLegalMove(board)) return board.inCheck() ? mated : Value(VALUE_DRAW);
+        return this->eval_tapered(board);
     }
-    else if (depth == 0) return this->eval_mid(board);
 
     Move move = Move();
     Movelist moves = Movelist();
     movegen::legalmoves(moves, board);
+    if (moves.empty()) return board.inCheck() ? mated : Value(VALUE_DRAW); //* Checkmate or stalemate.
     if (maximizing_player){
-        float maxEval = -9999.0f;
-        float evaluation = 0;
+        Value maxEval = -VALUE_INFINITE;
+        Value evaluation = VALUE_DRAW;
         order_moves(moves, board);
         for (int i = 0; i < moves.size(); i++){
             move = moves[i];
@@ -101,8 +403,8 @@ float Bot::minimax(int depth, float alpha, float beta, bool maximizing_player, B
         return maxEval;
     }
     else{
-        float minEval = 9999.0f;
-        float evaluation = 0;
+        Value minEval = VALUE_INFINITE;
+        Value evaluation = VALUE_DRAW;
         order_moves(moves, board);
         for (int i = 0; i < moves.size(); i++){
             move = moves[i];
@@ -118,23 +420,87 @@ float Bot::minimax(int depth, float alpha, float beta, bool maximizing_player, B
 }
 
 
-float Bot::search_move(Move move, Board board, int depth, int colour){
+Value Bot::search_root(SearchThread& thread, int depth, Value window_alpha, Value window_beta){
     /**
-     *  @brief Evaluates a specific move using negamax search algorithm.
+     *  @brief Searches every root move of a thread to the given depth with a shared alpha-beta window.
+     *
+     ** Unlike searching each root move in isolation, the window is narrowed as better moves are
+     ** found, so later root moves can be cut off early. As in Bot::negamax(), moves after the first
+     ** are searched with a zero window and only re-searched when they beat the best move so far.
+     ** The best move is moved to the front of SearchThread::root_moves (keeping the order of the
+     ** others) and stored in the thread, together with its principal variation.
+     *
+     ** The best line is searched within the given (aspiration) window. If its score falls outside,
+     ** the score is only a bound: it is returned without updating the thread's result, and the
+     ** caller re-searches with a wider window (see Bot::iterative_deepening()). A move that failed
+     ** high is moved to the front first, so the re-search starts with it.
+     *
+     ** With MultiPV (SearchLimits::multi_pv > 1) this is repeated for the next best lines: every
+     ** pass excludes the moves already ranked and starts from a full window again, so each of the
+     ** first N root moves gets an exact score. All passes share the transposition table, so the
+     ** later ones are much cheaper than separate searches. The ranked lines are kept in
+     ** SearchThread::lines, in the same order as the first N root moves.
      *
-     ** Performs a negamax search for a given move at a specified search depth,
-     ** taking into account the color perspective of the current player.
+     *  @param thread The search thread whose board and root moves are used.
+     *  @param depth The depth each root move is searched to after it has been played.
+     *  @param window_alpha Lower bound of the window for the best line (the MultiPV lines use a full window).
+     *  @param window_beta Upper bound of the window for the best line.
+     *  @return The score of the best root move from the side to move's perspective, or a bound
+     *          (at most window_alpha or at least window_beta) if the search failed low or high.
      *
-     *  @param move The chess move to evaluate
-     *  @param board The current board state
-     *  @param depth The maximum search depth for the evaluation
-     *  @param colour The color perspective (+1 for current player, -1 for opponent)
-     *  @return A float representing the evaluation score of the move
+     *  @note If the search is aborted midway, the thread's previous best move and lines are left untouched.
     */
 
-    float evaluation = 0;
-    board.makeMove(move);
-    evaluation = this->negamax(depth, -9999, 9999, board) * -colour;
-    board.unmakeMove(move);
-    return evaluation;
-}
\ No newline at end of file
+    Board& board = thread.board;
+    const int line_count = std::min<int>(std::max(this->limits.multi_pv, 1), thread.root_moves.size());
+    thread.static_evals[0] = board.inCheck() ? Value(VALUE_NONE) : this->evaluate(thread); //* Read by the ply 2 nodes.
+    std::vector<PvLine> lines(line_count);
+
+    for (int pv_index = 0; pv_index < line_count; pv_index++) {
+        const Value pass_alpha = pv_index == 0 ? window_alpha : Value(-VALUE_INFINITE);
+        const Value beta = pv_index == 0 ? window_beta : Value(VALUE_INFINITE);
+        Value alpha = pass_alpha;
+        Value best_score = -VALUE_INFINITE;
+        int best_index = pv_index;
+
+        for (int i = pv_index; i < thread.root_moves.size(); i++) {
+            Move move = thread.root_moves[i];
+            this->make_move(thread, move);
+            Value evaluation;
+            if (i == pv_index) {
+                evaluation = -this->negamax(depth, -beta, -alpha, thread);
+            } else {
+                evaluation = -this->negamax(depth, -alpha - 1, -alpha, thread);
+                if (evaluation > alpha && evaluation < beta) evaluation = -this->negamax(depth, -beta, -alpha, thread);
+            }
+            this->unmake_move(thread, move);
+            if (Bot::stop_search) return best_score;
+
+            if (evaluation > best_score) {
+                best_score = evaluation;
+                best_index = i;
+                thread.update_pv(move);
+            }
+            alpha = std::max(alpha, evaluation);
+            if (alpha >= beta) break; //* Failed high, no need to search the other moves.
+        }
+
+        Move best_move = thread.root_moves[best_index];
+        for (int i = best_index; i > pv_index; i--) thread.root_moves[i] = thread.root_moves[i - 1];
+        thread.root_moves[pv_index] = best_move;
+        if (best_score <= pass_alpha || best_score >= beta) return best_score; //* Only a bound, the caller re-searches.
+
+        lines[pv_index].score = best_score;
+        lines[pv_index].pv.assign(thread.pv[0], thread.pv[0] + thread.pv_length[0]);
+    }
+
+    //* Later passes can score above earlier ones (search instability): rank the lines by score.
+    std::stable_sort(lines.begin(), lines.end(), [](const PvLine& a, const PvLine& b) { return a.score > b.score; });
+    for (int i = 0; i < line_count; i++) thread.root_moves[i] = lines[i].pv[0];
+
+    thread.lines = std::move(lines);
+    thread.best_move = thread.root_moves[0];
+    thread.best_score = thread.lines[0].score;
+    TT.store(board.hash(), depth + 1, BOUND_EXACT, value_to_tt(thread.best_score, thread.ply), thread.best_move);
+    return thread.best_score;
+}
@@ -0,0 +1,76 @@
+/**
+ *  @file timeman.cpp
+ *  @brief Implements clock-based time management for the iterative deepening search.
+ *
+ ** The TimeManager turns the "wtime/btime/winc/binc/movestogo/movetime" parameters of a UCI
+ ** "go" command into a soft and a hard time budget for the current move. The soft budget
+ ** decides whether another iterative deepening iteration is worth starting, while the hard
+ ** budget is polled from inside the search to abort it (see Bot::should_stop()).
+ *
+ *? Allocation strategy:
+ *? - movetime: both budgets are the requested time minus the move overhead.
+ *? - clock: a slice of the remaining time (based on movestogo, or an assumed 30 moves in
+ *?   sudden death) plus most of the increment, with the hard budget capped at a fraction of
+ *?   the clock so a single move can never flag.
+ *
+ *  @note All times are in milliseconds.
+*/
+
+void TimeManager::init(const SearchLimits& limits, Color side_to_move) {
+    /**
+     *  @brief Computes the soft and hard budgets for the move about to be searched.
+     *
+     ** Resets the start time to now. If the limits contain neither a movetime nor a
+     ** clock for the side to move, both budgets are disabled and the search is only
+     ** bounded by depth.
+     *
+     *  @param limits        The parsed "go" command (including the "Move Overhead" option).
+     *  @param side_to_move  The colour the engine is searching for.
+    */
+    this->start = std::chrono::steady_clock::now();
+    this->soft_limit = -1;
+    this->hard_limit = -1;
+
+    if (limits.movetime >= 0) {
+        this->hard_limit = std::max<int64_t>(1, limits.movetime - limits.move_overhead);
+        this->soft_limit = this->hard_limit;
+        return;
+    }
+
+    int time = side_to_move == Color::WHITE ? limits.wtime : limits.btime;
+    int inc = side_to_move == Color::WHITE ? limits.winc : limits.binc;
+    if (time < 0) return;
+
+    int64_t time_left = std::max<int64_t>(1, time - limits.move_overhead);
+    int64_t moves_to_go = limits.movestogo > 0 ? std::min(limits.movestogo, 50) : 30;
+
+    int64_t optimum = time_left / moves_to_go + inc * 3 / 4;
+    int64_t maximum = std::min<int64_t>(time_left * 4 / 5, optimum * 5);
+
+    this->hard_limit = std::max<int64_t>(1, maximum);
+    this->soft_limit = std::max<int64_t>(1, std::min(optimum, this->hard_limit));
+}
+
+int64_t TimeManager::elapsed() const {
+    /**
+     *  @brief Milliseconds since the last call to TimeManager::init().
+    */
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - this->start).count();
+}
+
+bool TimeManager::soft_limit_reached() const {
+    /**
+     *  @brief Checks whether a new iterative deepening iteration should not be started.
+     *
+     ** An iteration usually takes several times longer than the previous one, so the soft
+     ** limit is considered reached once about half of it has been used.
+    */
+    return this->soft_limit >= 0 && this->elapsed() * 2 >= this->soft_limit;
+}
+
+bool TimeManager::hard_limit_reached() const {
+    /**
+     *  @brief Checks whether the running search must be aborted immediately.
+    */
+    return this->hard_limit >= 0 && this->elapsed() >= this->hard_limit;
+}
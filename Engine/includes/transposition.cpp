@@ -0,0 +1,265 @@
+/**
+ *  @file transposition.cpp
+ *  @brief Implements a shared, lock-free transposition table keyed by the board's Zobrist hash.
+ *
+ ** The transposition table caches the result of previous searches so that positions reached
+ ** through different move orders (or again on the next "go" command) do not have to be searched
+ ** from scratch. It is shared by every search thread and is never locked: each slot stores the
+ ** key XOR-ed with its data word, so a torn write from two racing threads simply fails the
+ ** verification on the next probe instead of returning corrupt data.
+ *
+ *? Layout:
+ *? - The table is an array of 64-byte (cache line sized) buckets holding four entries each.
+ *? - An entry is two 64-bit words: (key ^ data) and data.
+ *? - The data word packs the best move, score, depth, bound type and search generation.
+ *
+ ** Mate scores are stored relative to the stored position instead of the root (see value_to_tt()),
+ ** since the same position can be reached at a different distance from the root later.
+ *
+ *  @note The table is sized in megabytes through the UCI "Hash" option and defaults to 16 MB.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+
+enum Bound : uint8_t {
+    BOUND_NONE  = 0,
+    BOUND_UPPER = 1, //* Fail-low: the real score is at most the stored score.
+    BOUND_LOWER = 2, //* Fail-high: the real score is at least the stored score.
+    BOUND_EXACT = 3
+};
+
+struct TTData {
+    /**
+     *  @struct TTData
+     *  @brief Unpacked contents of a transposition table entry, returned by TranspositionTable::probe().
+    */
+    Move move = Move::NO_MOVE;
+    Value score = VALUE_DRAW;   //* As stored: convert with value_from_tt() before use.
+    int depth = 0;
+    Bound bound = BOUND_NONE;
+};
+
+inline Value value_to_tt(Value value, int ply) {
+    /**
+     *  @brief Converts a mate score from "plies from the root" to "plies from this position" for storing.
+    */
+    if (value >= VALUE_MATE_IN_MAX_PLY) return static_cast<Value>(value + ply);
+    if (value <= VALUE_MATED_IN_MAX_PLY) return static_cast<Value>(value - ply);
+    return value;
+}
+
+inline Value value_from_tt(Value value, int ply) {
+    /**
+     *  @brief Converts a stored mate score back to "plies from the root" of the probing search.
+    */
+    if (value >= VALUE_MATE_IN_MAX_PLY) return static_cast<Value>(value - ply);
+    if (value <= VALUE_MATED_IN_MAX_PLY) return static_cast<Value>(value + ply);
+    return value;
+}
+
+class TranspositionTable {
+    /**
+     *  @class TranspositionTable
+     *  @brief Fixed-size, bucketed hash table of search results shared between all search threads.
+     *
+     ** Entries are addressed by the low bits of the Zobrist key and verified with the full key.
+     ** All reads and writes are relaxed atomics, so concurrent probes and stores from the
+     ** search threads are race-free without a mutex.
+     *
+     *? Replacement scheme:
+     *? - An entry with the same key is always overwritten.
+     *? - Otherwise the shallowest entry, preferring entries from older searches, is replaced.
+    */
+    public:
+        TranspositionTable();
+
+        void resize(size_t megabytes);
+        void clear();
+        void new_search();
+
+        bool probe(uint64_t key, TTData& data) const;
+        void store(uint64_t key, int depth, Bound bound, Value score, Move move);
+        int hashfull() const;
+
+    private:
+        static constexpr int BUCKET_SIZE = 4;
+        static constexpr uint8_t GENERATION_MASK = 0x3F;
+
+        struct Entry {
+            std::atomic<uint64_t> key;
+            std::atomic<uint64_t> data;
+        };
+
+        struct alignas(64) Bucket {
+            Entry entries[BUCKET_SIZE];
+        };
+
+        std::unique_ptr<Bucket[]> buckets;
+        size_t bucket_mask = 0;
+        uint8_t generation = 0;
+
+        static uint64_t pack(Move move, Value score, int depth, Bound bound, uint8_t generation);
+        static TTData unpack(uint64_t data);
+        static uint8_t generation_of(uint64_t data) { return (data >> 58) & GENERATION_MASK; }
+        static int depth_of(uint64_t data) { return (data >> 48) & 0xFF; }
+};
+
+TranspositionTable::TranspositionTable() {
+    /**
+     *  @brief Allocates the table with the default size advertised for the "Hash" option (16 MB).
+    */
+    this->resize(16);
+}
+
+void TranspositionTable::resize(size_t megabytes) {
+    /**
+     *  @brief Reallocates the table to (at most) the given size and clears it.
+     *
+     ** The bucket count is rounded down to a power of two so that a bucket can be selected
+     ** with a mask instead of a division. If the allocation fails the previous table is kept.
+     *
+     *  @param megabytes Requested table size in megabytes (the UCI "Hash" option value).
+    */
+    size_t bytes = std::max<size_t>(megabytes, 1) * 1024 * 1024;
+    size_t count = 1;
+    while (count * 2 * sizeof(Bucket) <= bytes) count *= 2;
+
+    Bucket* table = new (std::nothrow) Bucket[count];
+    if (table == nullptr) {
+        Bot::LogToFile("Error: Could not allocate " + std::to_string(megabytes) + " MB for the hash table");
+        return;
+    }
+    this->buckets.reset(table);
+    this->bucket_mask = count - 1;
+    this->clear();
+}
+
+void TranspositionTable::clear() {
+    /**
+     *  @brief Empties every entry in the table (used by "ucinewgame" and the "Clear Hash" option).
+    */
+    for (size_t i = 0; i <= this->bucket_mask; i++) {
+        for (Entry& entry : this->buckets[i].entries) {
+            entry.key.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    this->generation = 0;
+}
+
+void TranspositionTable::new_search() {
+    /**
+     *  @brief Advances the search generation so entries from earlier searches are replaced first.
+     *
+     ** Must be called once per "go" command, before any search thread is started.
+    */
+    this->generation = (this->generation + 1) & GENERATION_MASK;
+}
+
+int TranspositionTable::hashfull() const {
+    /**
+     *  @brief Estimates how full the table is, in permille, for the UCI "hashfull" info.
+     *
+     ** Samples the first 1000 entries (or the whole table, if smaller) and counts the ones
+     ** written during the current search.
+    */
+    int used = 0;
+    int sampled = 0;
+    for (size_t i = 0; i <= this->bucket_mask && sampled < 1000; i++) {
+        for (const Entry& entry : this->buckets[i].entries) {
+            uint64_t stored = entry.data.load(std::memory_order_relaxed);
+            if (stored != 0 && generation_of(stored) == this->generation) used++;
+            sampled++;
+        }
+    }
+    return used * 1000 / std::max(sampled, 1);
+}
+
+uint64_t TranspositionTable::pack(Move move, Value score, int depth, Bound bound, uint8_t generation) {
+    /**
+     *  @brief Packs an entry into a single 64-bit data word.
+     *
+     *? Bit layout: [0, 16) move | [16, 32) score | [32, 48) unused | [48, 56) depth | [56, 58) bound | [58, 64) generation
+    */
+    const uint16_t score_bits = static_cast<uint16_t>(score);
+    return  static_cast<uint64_t>(move.move())
+         | (static_cast<uint64_t>(score_bits) << 16)
+         | (static_cast<uint64_t>(std::min(std::max(depth, 0), 255)) << 48)
+         | (static_cast<uint64_t>(bound) << 56)
+         | (static_cast<uint64_t>(generation & GENERATION_MASK) << 58);
+}
+
+TTData TranspositionTable::unpack(uint64_t data) {
+    /**
+     *  @brief Unpacks a 64-bit data word produced by TranspositionTable::pack().
+    */
+    TTData result;
+    result.score = static_cast<Value>(static_cast<uint16_t>(data >> 16));
+    result.move = Move(static_cast<uint16_t>(data & 0xFFFF));
+    result.depth = depth_of(data);
+    result.bound = static_cast<Bound>((data >> 56) & 0x3);
+    return result;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData& data) const {
+    /**
+     *  @brief Looks up a position in the table.
+     *
+     *  @param key  Zobrist hash of the position (Board::hash()).
+     *  @param data Receives the stored entry on a hit; left untouched on a miss.
+     *  @return True if a verified entry for the key was found.
+    */
+    const Bucket& bucket = this->buckets[key & this->bucket_mask];
+    for (const Entry& entry : bucket.entries) {
+        uint64_t stored = entry.data.load(std::memory_order_relaxed);
+        if ((entry.key.load(std::memory_order_relaxed) ^ stored) == key && stored != 0) {
+            data = unpack(stored);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, Bound bound, Value score, Move move) {
+    /**
+     *  @brief Saves a search result in the table.
+     *
+     ** Overwrites the entry for the same key if present (keeping its best move when the new
+     ** result has none), otherwise replaces the least valuable entry of the bucket.
+     *
+     *  @param key   Zobrist hash of the position.
+     *  @param depth Remaining depth the score was searched to.
+     *  @param bound Whether the score is exact, a lower bound or an upper bound.
+     *  @param score Score from the side to move's perspective, converted with value_to_tt().
+     *  @param move  Best (or refutation) move found, or Move::NO_MOVE.
+    */
+    Bucket& bucket = this->buckets[key & this->bucket_mask];
+    Entry* replace = &bucket.entries[0];
+    int worst = INT32_MAX;
+
+    for (Entry& entry : bucket.entries) {
+        uint64_t stored = entry.data.load(std::memory_order_relaxed);
+        if ((entry.key.load(std::memory_order_relaxed) ^ stored) == key) {
+            if (move == Move::NO_MOVE) move = Move(static_cast<uint16_t>(stored & 0xFFFF));
+            replace = &entry;
+            break;
+        }
+        // Empty slots go first, then older generations lose 8 plies of "worth" per search they are behind.
+        int age = (this->generation - generation_of(stored)) & GENERATION_MASK;
+        int worth = stored == 0 ? INT32_MIN : depth_of(stored) - 8 * age;
+        if (worth < worst) {
+            worst = worth;
+            replace = &entry;
+        }
+    }
+
+    uint64_t data = pack(move, score, depth, bound, this->generation);
+    replace->key.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+TranspositionTable TT; //* Shared by every Bot instance and search thread for the lifetime of the process.
@@ -8,13 +8,17 @@
  *
  *? Key responsibilities:
  *? - Maintain a Bot instance for search and move generation
- *? - Manage board state updates and position setup
+ *? - Manage board state updates and position setup (incrementally while a game goes on)
  *? - Convert moves from UCI format and relay to Bot methods
  *? - Return current FEN or best move to external controllers
+ *? - Run "go" searches on a dedicated thread so the UCI loop stays responsive, including pondering
  *
  *  @note This class provides a simplified abstraction for integrating the Bot engine into UCI-compliant interfaces.
 */
 
+#include <condition_variable>
+#include <mutex>
+
 #include "bot.cpp"
 
 class UciPlayer {
@@ -35,19 +39,39 @@ class UciPlayer {
     public:
         Bot bot;
         UciPlayer();
+        ~UciPlayer();
+
+        int move_overhead = 10; //* UCI "Move Overhead" option, in milliseconds.
+        int multi_pv = 1;       //* UCI "MultiPV" option: number of ranked lines to search and report.
 
         //* Uci Methods
         void NotifyNewGame();
-        void SetPosition(std::string fen);
+        int SetPosition(const std::string& fen, const std::vector<std::string>& moves = {});
         void ProcessPositionCommand(std::string message);
         void ProcessGoCommand(std::string message);
         void Quit();
 
+        //* Search thread control
+        void StartSearch(SearchLimits limits, std::function<void(const std::string&)> on_info,
+                         std::function<void(const std::string&, const std::string&)> on_best_move);
+        void StopSearch();
+        void PonderHit();
+
         //* Essential Bot Methods
         void MakeMove(std::string move);
 
         std::string getFen();
-        std::string getBestMove();
+        std::string getBestMove(SearchLimits limits = SearchLimits());
+
+    private:
+        //* The last "position" command, so the next one only needs to play the new moves.
+        std::string position_fen;
+        std::vector<std::string> position_moves;
+
+        std::thread searcher;
+        std::mutex stop_mutex;
+        std::condition_variable stop_condition;
+        bool stop_requested = false; //* Set by StopSearch(), guarded by stop_mutex (as is lowering Bot::pondering).
 };
 
 UciPlayer::UciPlayer() {
@@ -59,13 +83,25 @@ UciPlayer::UciPlayer() {
     this->bot = Bot();
 }
 
+UciPlayer::~UciPlayer() {
+    /**
+     *  @brief Stops and joins a running search before the Bot it uses goes away.
+    */
+    this->StopSearch();
+}
+
 void UciPlayer::NotifyNewGame() {
     /**
      *  @brief Resets the internal Bot instance to start a new game.
      *
-     ** Called when a new game is initiated via the UCI protocol.
+     ** Called when a new game is initiated via the UCI protocol. Also clears the shared
+     ** transposition table, since positions from the previous game are unlikely to recur,
+     ** and forgets the last position so the next "position" command starts from scratch.
     */
     this->bot = Bot();
+    this->position_fen.clear();
+    this->position_moves.clear();
+    TT.clear();
 }
 
 void UciPlayer::Quit() {
@@ -80,17 +116,36 @@ void UciPlayer::Quit() {
     UciPlayer::NotifyNewGame();
 }
 
-void UciPlayer::SetPosition(std::string fen) {
+int UciPlayer::SetPosition(const std::string& fen, const std::vector<std::string>& moves) {
     /**
      *  @brief Sets the board position for the current game session.
      *
-     ** Initialises a new Bot instance with the specified Forsyth-Edwards Notation (FEN) string,
-     ** effectively resetting the board to the given position.
+     ** If the position is the previous one extended by new moves (the usual case during a game),
+     ** only the new moves are played on the current board and the Bot is kept, so its search
+     ** state carries over to the next search. Otherwise a new Bot instance is initialised with
+     ** the specified Forsyth-Edwards Notation (FEN) string and every move is played.
      *
-     * @param fen A standard chess FEN string representing the board state
+     *  @param fen   A standard chess FEN string representing the starting board state.
+     *  @param moves The moves played from that position, in UCI format.
+     *  @return The number of moves that had to be played.
     */
-    
-    this->bot = Bot(fen);
+
+    bool extends = fen == this->position_fen && moves.size() >= this->position_moves.size()
+                && std::equal(this->position_moves.begin(), this->position_moves.end(), moves.begin());
+    size_t first_new = this->position_moves.size();
+    if (!extends) {
+        this->bot = Bot(fen);
+        this->position_fen = fen;
+        this->position_moves.clear();
+        first_new = 0;
+    }
+
+    for (size_t i = first_new; i < moves.size(); i++) {
+        if (moves[i].empty()) continue;
+        this->MakeMove(moves[i]);
+    }
+    this->position_moves = moves;
+    return static_cast<int>(moves.size() - first_new);
 }
 
 void UciPlayer::MakeMove(std::string move) {
@@ -115,18 +170,95 @@ std::string UciPlayer::getFen() {
     return this->bot.board.getFen();
 }
 
-std::string UciPlayer::getBestMove() {
+std::string UciPlayer::getBestMove(SearchLimits limits) {
     /**
      *  @brief Retrieves the best move for the current board state.
      *
      ** Determines the optimal move for the side currently to move using the bot's 
      ** move selection algorithm. The side is specified by the current board's side to move.
+     ** Runs on the calling thread; Bot::stop_search must have been lowered by the caller.
      *
+     *  @param limits Clock and depth constraints from the "go" command.
      *  @return A string representing the best move in UCI move notation
     */
     
+    limits.move_overhead = this->move_overhead;
+    limits.multi_pv = this->multi_pv;
     char colour;
     if (this->bot.board.sideToMove() == Color::WHITE) colour = 'w';
     else colour = 'b';
-    return this->bot.get_best_move(this->bot.board, colour);
-}
\ No newline at end of file
+    return this->bot.get_best_move(this->bot.board, colour, limits);
+}
+void UciPlayer::StartSearch(SearchLimits limits, std::function<void(const std::string&)> on_info,
+                            std::function<void(const std::string&, const std::string&)> on_best_move) {
+    /**
+     *  @brief Starts searching the current position on a dedicated thread and returns immediately.
+     *
+     ** The input loop keeps reading commands meanwhile, so "stop", "isready" and "quit" are handled
+     ** while the engine thinks. The search threads poll Bot::stop_search at every node, so a
+     ** "stop" is answered within one node of work plus the time to unwind the search.
+     *
+     ** An infinite search ("go infinite") does not report its move when it runs out of depth:
+     ** as the UCI protocol requires, the best move is only sent after "stop". Likewise a ponder
+     ** search ("go ponder") waits for "ponderhit" or "stop" (see UciPlayer::PonderHit()).
+     *
+     *  @param limits        Clock and depth constraints from the "go" command.
+     *  @param on_info       Called on the search thread with every "info" line of the search.
+     *  @param on_best_move  Called on the search thread with the best move and the expected
+     *                       reply (empty if unknown), both in UCI format.
+    */
+
+    this->StopSearch(); //* Never run two searches on the same Bot.
+
+    Bot::stop_search = false;
+    Bot::pondering = limits.ponder;
+    this->bot.on_info = on_info;
+    this->stop_requested = false;
+    this->searcher = std::thread([this, limits, on_best_move]() {
+        std::string best_move = this->getBestMove(limits);
+        {
+            std::unique_lock<std::mutex> lock(this->stop_mutex);
+            this->stop_condition.wait(lock, [this, &limits]() {
+                return this->stop_requested || (!limits.infinite && !Bot::pondering);
+            });
+        }
+        on_best_move(best_move, this->bot.get_ponder_move());
+    });
+}
+
+void UciPlayer::StopSearch() {
+    /**
+     *  @brief Aborts the running search, if any, and waits until its best move has been reported.
+     *
+     ** Safe to call when no search is running. Every command that reads or changes the engine
+     ** state stops the search first, so the Bot is never used by two threads at once.
+    */
+
+    {
+        std::lock_guard<std::mutex> guard(this->stop_mutex);
+        this->stop_requested = true;
+        Bot::pondering = false;
+    }
+    Bot::stop_search = true;
+    this->stop_condition.notify_all();
+    if (this->searcher.joinable()) this->searcher.join();
+}
+
+void UciPlayer::PonderHit() {
+    /**
+     *  @brief Handles "ponderhit": the opponent played the expected move.
+     *
+     ** The ponder search simply becomes a normal timed search. It keeps its tree, transposition
+     ** table and the depth it already reached, and its time budget is measured from the "go ponder"
+     ** command, so the time spent pondering is carried over: if it already exceeds the budget, the
+     ** search stops at the next time check (or after its current iteration) and moves at once.
+     ** The engine's real clock only started at "ponderhit", so this can never use more time than
+     ** the budget allows. A ponder search that already finished reports its move immediately.
+    */
+
+    {
+        std::lock_guard<std::mutex> guard(this->stop_mutex);
+        Bot::pondering = false;
+    }
+    this->stop_condition.notify_all();
+}
@@ -38,20 +38,33 @@ void ReceiveCommand(std::string message, UciPlayer& player){
      *? Supported commands:
      *?  - "uci"           : Respond with engine identification and options.
      *?  - "isready"       : Confirm readiness with "readyok".
+     *?  - "setoption"     : Change a supported engine option (e.g. "Hash").
      *?  - "ucinewgame"    : Signal a new game to reset state.
      *?  - "position"      : Set up the board with a given FEN or move list.
-     *?  - "go"            : Begin calculating best move based on the current position.
+     *?  - "go"            : Begin calculating best move based on the current position (on the search thread).
+     *?  - "stop"          : Stop the running search; its best move is reported right away.
+     *?  - "ponderhit"     : The expected move was played; the ponder search continues on the clock.
      *?  - "quit"          : Exit the engine.
      *?  - "d"             : Print the current board to stdout (non-standard debug command).
+     *?  - "nnuebench"     : Verify and time the NNUE kernel variants (non-standard debug command).
+     *?  - "makebook"      : Convert the JSON opening book to the binary book (non-standard tool command).
+     *
+     ** A running search is stopped before any command other than "isready" and "ponderhit" is
+     ** handled, so the engine state is never read or changed while the search thread uses it.
      *
      ** Logs unrecognised commands for debugging purposes.
     */
     Bot::LogToFile("Command received: " + message);
     message = trim(message);
 	std::string messageType = lower(split(message, ' ')[0]);
+
+    if (messageType == "ponderhit") return player.PonderHit();
+    if (messageType != "isready") player.StopSearch();
     
     if (messageType == "uci") DisplayOptions();
+    else if (messageType == "stop") return; //* Already stopped above.
     else if (messageType == "isready") Respond("readyok");
+    else if (messageType == "setoption") ProcessSetOptionCommand(message, player);
     else if (messageType == "ucinewgame") player.NotifyNewGame();
     else if (messageType == "position") ProcessPositionCommand(message, player);
     else if (messageType == "go") ProcessGoCommand(message, player);
@@ -60,6 +73,8 @@ void ReceiveCommand(std::string message, UciPlayer& player){
     else if (messageType == "h" || messageType == "help") PrintHelp();
     else if (messageType == "perft") ProcessPerftCommand(message, player);
     else if (messageType == "eval") ProcessEvalCommand(message, player);
+    else if (messageType == "nnuebench") ProcessNnueBenchCommand();
+    else if (messageType == "makebook") ProcessMakeBookCommand(message);
     else if (messageType == "cls") clearScreen();
     else Respond("Unrecognised command: " + messageType + " | " + message);
 }
@@ -68,22 +83,24 @@ int main () {
     /**
      *  @brief Entry point for the UCI engine executable.
      *
-     ** Initialises the NNUE (Efficiently Updatable Neural Network) evaluation module 
-     ** and enters a loop that listens for and processes UCI commands from standard input.
+     ** Loads the process-wide resources once, the NNUE (Efficiently Updatable Neural Network)
+     ** weights and the opening book, and enters a loop that listens for and processes UCI commands from standard input.
      *
-     ** The function continuously reads input commands until the "quit" command is issued,
-     ** at which point the engine logs shutdown activity and exits gracefully.
+     ** The function continuously reads input commands until the "quit" command is issued (or the
+     ** input is closed), at which point the engine logs shutdown activity and exits gracefully.
+     ** Searches run on their own thread (see UciPlayer::StartSearch()), so this loop keeps
+     ** reading commands while the engine thinks.
      *
      *  @return Exit status code (0 for successful termination).
     */
 
-    init_nnue("includes\\NNUE\\v4.nnue");
+    Resources.load("includes\\NNUE\\v4.nnue", "includes\\OpeningBook\\book.bin");
     
     UciPlayer player;
     std::string command = "";
     while (lower(command) != "quit" && lower(command) != "exit" && lower(command) != "q")
     {
-        std::getline(std::cin, command);
+        if (!std::getline(std::cin, command)) command = "quit";
         ReceiveCommand(command, player);
     }
     Bot::LogToFile("CLOSING UCI bot");